@@ -0,0 +1,310 @@
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+
+#include <cli/cli.hpp>
+
+#include <charconv>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+
+namespace {
+struct BenchConfig : cli::DefaultConfig {
+  using SizeT = uint16_t;
+  static constexpr std::size_t cmdCountMax = 10000;
+  static constexpr std::size_t cmdTokensMax = 4;
+  static constexpr std::size_t trieNodesMax = 2 * cmdCountMax;
+};
+using BenchCLI = cli::BasicCLI<BenchConfig>;
+
+struct CachedConfig : BenchConfig {
+  static constexpr std::size_t commandCacheSize = 8;
+};
+
+struct StatsConfig : cli::DefaultConfig {
+  static constexpr bool stats = true;
+};
+#ifdef CLI_HAS_TSC
+struct TscConfig : StatsConfig {
+  using StatsClock = cli::TscClock;
+};
+#endif
+
+// room for "cmd%04d get ?i" with any int
+constexpr int patternLen = 24;
+char patterns[BenchConfig::cmdCountMax][patternLen];
+
+const char *pattern(int i) {
+  if (patterns[i][0] == 0) {
+    std::snprintf(patterns[i], patternLen, "cmd%04d get ?i", i);
+  }
+  return patterns[i];
+}
+
+// commands are "cmdNNNN get ?i", the trailing placeholder forces a schema parse
+template <typename Config = BenchConfig>
+std::unique_ptr<cli::BasicCLI<Config>> makeCli(int count, int &sink) {
+  auto cli = std::make_unique<cli::BasicCLI<Config>>();
+  cli->withDefaultSchemas();
+  for (int i = 0; i < count; i++) {
+    cli->withCommand(pattern(i), [&sink](const auto &args) {
+      sink += args[2].template get<int>();
+    });
+  }
+  return cli;
+}
+} // namespace
+
+TEST_CASE("dispatch latency", "[benchmark]") {
+  for (const int count : {4, 16, 256, 4096}) {
+    int sink = 0;
+    const auto cli = makeCli(count, sink);
+    char last[patternLen];
+    std::snprintf(last, patternLen, "cmd%04d get 1", count - 1);
+
+    const auto name = [count](const char *what) {
+      return std::string(what) + " @" + std::to_string(count);
+    };
+    BENCHMARK(name("hit first")) { return cli->run("cmd0000 get 1"); };
+    BENCHMARK(name("hit last")) { return cli->run(last); };
+    BENCHMARK(name("miss literal")) { return cli->run("nosuch get 1"); };
+    BENCHMARK(name("miss schema")) { return cli->run("cmd0000 get x"); };
+  }
+}
+
+// telemetry polling: nine in ten lines are one of two commands
+TEST_CASE("command cache", "[benchmark]") {
+  const char *const hot[] = {"get voltage", "get temp 2"};
+  std::string cold[16];
+  for (int i = 0; i < 16; i++) {
+    char line[patternLen];
+    std::snprintf(line, patternLen, "cmd%04d get 1", i * 15);
+    cold[i] = line;
+  }
+  const char *lines[100];
+  for (int i = 0; i < 100; i++) {
+    lines[i] = i % 10 == 9 ? cold[i / 10].c_str() : hot[i % 2];
+  }
+
+  for (const int count : {16, 256}) {
+    int sink = 0;
+    const auto callback = [&sink](const auto &) { sink++; };
+    auto plain = makeCli(count, sink);
+    auto cached = makeCli<CachedConfig>(count, sink);
+    plain->withCommand("get voltage", callback)
+        .withCommand("get temp ?i", callback);
+    cached->withCommand("get voltage", callback)
+        .withCommand("get temp ?i", callback);
+
+    const auto name = [count](const char *what) {
+      return std::string(what) + " @" + std::to_string(count);
+    };
+    BENCHMARK(name("100 skewed lines without cache")) {
+      int matched = 0;
+      for (const char *line : lines) {
+        matched += plain->run(line) ? 1 : 0;
+      }
+      return matched;
+    };
+    BENCHMARK(name("100 skewed lines with cache")) {
+      int matched = 0;
+      for (const char *line : lines) {
+        matched += cached->run(line) ? 1 : 0;
+      }
+      return matched;
+    };
+    // the hot lines stay cached, the cold ones miss
+    CHECK(cached->cache().hits() >= 4 * cached->cache().misses());
+  }
+}
+
+TEST_CASE("stats overhead", "[benchmark]") {
+  int sink = 0;
+  const auto callback = [&sink](int value) { sink += value; };
+  const auto plain = cli::CLI().withDefaultSchemas().withCommand("set ?i",
+                                                                 callback);
+  const auto counted = cli::BasicCLI<StatsConfig>()
+                           .withDefaultSchemas()
+                           .withCommand("set ?i", callback);
+#ifdef CLI_HAS_TSC
+  const auto tsc = cli::BasicCLI<TscConfig>().withDefaultSchemas().withCommand(
+      "set ?i", callback);
+  BENCHMARK("hit with stats (rdtsc)") { return tsc.run("set 1"); };
+#endif
+
+  BENCHMARK("hit without stats") { return plain.run("set 1"); };
+  BENCHMARK("hit with stats (steady_clock)") { return counted.run("set 1"); };
+}
+
+TEST_CASE("help", "[benchmark]") {
+  for (const int count : {4, 256}) {
+    int sink = 0;
+    const auto cli = makeCli(count, sink);
+    BENCHMARK("help @" + std::to_string(count)) {
+      std::size_t written = 0;
+      cli->getHelp([&](const char *text, int len) { written += len; });
+      return written;
+    };
+  }
+}
+
+TEST_CASE("completion", "[benchmark]") {
+  for (const int count : {16, 4096}) {
+    int sink = 0;
+    const auto cli = makeCli(count, sink);
+    std::size_t candidates = 0;
+    const auto onCandidate = [&candidates](const cli::Token &) { candidates++; };
+
+    const auto name = [count](const char *what) {
+      return std::string(what) + " @" + std::to_string(count);
+    };
+    BENCHMARK(name("complete line from scratch")) {
+      cli->complete("cmd0001 get ", onCandidate);
+      return candidates;
+    };
+    // the session keeps "cmd0001 ge" and types one more character
+    cli::BasicCompletionSession<BenchConfig, 32> session(*cli);
+    for (const char *c = "cmd0001 ge"; *c != 0; c++) {
+      session.push(*c);
+    }
+    BENCHMARK(name("keystroke and complete")) {
+      session.push('t');
+      session.complete(onCandidate);
+      session.pop();
+      return candidates;
+    };
+    BENCHMARK(name("keystroke")) {
+      session.push('x');
+      session.pop();
+      return session.len();
+    };
+  }
+}
+
+TEST_CASE("startup", "[benchmark]") {
+  for (const int count : {1000, 4000, 10000}) {
+    int sink = 0;
+    // includes allocating and clearing the tables of BenchConfig
+    BENCHMARK("register " + std::to_string(count) + " commands") {
+      return makeCli(count, sink);
+    };
+  }
+}
+
+TEST_CASE("line reader throughput", "[benchmark]") {
+  std::string script;
+  while (script.size() < 4 * 1024 * 1024) {
+    script += "cmd0001 get 42\r\n";
+  }
+
+  for (const std::size_t chunk : {std::size_t(16), std::size_t(4096)}) {
+    BENCHMARK("4 MiB script in chunks of " + std::to_string(chunk)) {
+      cli::LineReader<128> reader;
+      std::size_t lines = 0;
+      for (std::size_t i = 0; i < script.size(); i += chunk) {
+        lines += reader.feed(script.data() + i,
+                             std::min(chunk, script.size() - i),
+                             [](const char *line) {});
+      }
+      return lines;
+    };
+  }
+}
+
+TEST_CASE("tokenizer", "[benchmark]") {
+  const char *shortLine = "pm lim vin 3 5";
+  const std::string longLine =
+      "calibrate channel_0123456789 offset_table_entry   "
+      "-0.000123456789 +12345.678 some_fairly_long_identifier_name\tend";
+  BENCHMARK("short line") { return cli::parsers::tokenParser(shortLine); };
+  BENCHMARK("long line") {
+    return cli::parsers::tokenParser(longLine.c_str());
+  };
+  const char *quotedLine = R"(echo "hello world" 'it\'s')";
+  BENCHMARK("quoted line") { return cli::parsers::tokenParser(quotedLine); };
+}
+
+TEST_CASE("default schemas", "[benchmark]") {
+  const cli::Token integer("-1043", 5);
+  const cli::Token decimal("-3.141516", 9);
+  const cli::Token text("voltage", 7);
+  const cli::Token pattern("?i", 2);
+  cli::Argument arg;
+
+  BENCHMARK("?i") { return cli::schemaInteger.parse(integer, arg); };
+  BENCHMARK("?f") { return cli::schemaFloat.parse(decimal, arg); };
+  BENCHMARK("?s") { return cli::schemaText.parse(text, arg); };
+
+  cli::Schemas schemas;
+  schemas.push_back(cli::schemaFloat);
+  schemas.push_back(cli::schemaText);
+  schemas.push_back(cli::schemaInteger);
+  BENCHMARK("argumentParser ?i") {
+    return cli::parsers::argumentParser(schemas, pattern, integer);
+  };
+}
+
+TEST_CASE("numeric parsers", "[benchmark]") {
+  const char *const integers[] = {"7", "-1043", "123456789", "+2147483647"};
+  const char *const floats[] = {"0.5", "-3.141516", "1e-3", "12345.678901"};
+  const auto tokens = [](const char *const(&texts)[4]) {
+    std::array<cli::Token, 4> result;
+    for (int i = 0; i < 4; i++) {
+      result[i] = cli::Token(texts[i], std::strlen(texts[i]));
+    }
+    return result;
+  };
+  const auto integerTokens = tokens(integers);
+  const auto floatTokens = tokens(floats);
+
+  BENCHMARK("parseInteger") {
+    int sum = 0, value = 0;
+    for (const auto &token : integerTokens) {
+      cli::parsers::parseInteger(token, value);
+      sum += value;
+    }
+    return sum;
+  };
+  BENCHMARK("strtol") {
+    long sum = 0;
+    for (const char *text : integers) {
+      sum += std::strtol(text, nullptr, 10);
+    }
+    return sum;
+  };
+  BENCHMARK("from_chars int") {
+    int sum = 0, value = 0;
+    for (const auto &token : integerTokens) {
+      // from_chars doesn't accept a leading '+'
+      const char *begin = token.str() + (token.str()[0] == '+');
+      std::from_chars(begin, token.str() + token.len(), value);
+      sum += value;
+    }
+    return sum;
+  };
+
+  BENCHMARK("parseFloat") {
+    float sum = 0, value = 0;
+    for (const auto &token : floatTokens) {
+      cli::parsers::parseFloat(token, value);
+      sum += value;
+    }
+    return sum;
+  };
+  BENCHMARK("strtof") {
+    float sum = 0;
+    for (const char *text : floats) {
+      sum += std::strtof(text, nullptr);
+    }
+    return sum;
+  };
+  BENCHMARK("from_chars float") {
+    float sum = 0, value = 0;
+    for (const auto &token : floatTokens) {
+      std::from_chars(token.str(), token.str() + token.len(), value);
+      sum += value;
+    }
+    return sum;
+  };
+}
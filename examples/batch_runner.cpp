@@ -0,0 +1,54 @@
+/* @file Replays a script file through the CLI and reports the throughput
+ *  Run with ./batch_runner script.txt
+ */
+
+#include <chrono>
+#include <iostream>
+
+#include <cli/script.hpp>
+
+int main(int argc, char *argv[]) {
+  if (argc != 2) {
+    std::cerr << "usage: " << argv[0] << " script" << std::endl;
+    return 1;
+  }
+
+  int minLimit = 0, maxLimit = 0, voltage = 0;
+  float ratio = 0.0f;
+  const auto cli =
+      cli::CLI()
+          .withDefaultSchemas()
+          .withCommand("pm lim vin ?i ?i",
+                       [&](int min, int max) {
+                         minLimit = min;
+                         maxLimit = max;
+                       })
+          .withCommand("ratio set ?f", [&](float r) { ratio = r; })
+          .withCommand("set voltage ?i", [&](int v) { voltage = v; });
+
+  std::size_t lines = 0;
+  const auto start = std::chrono::steady_clock::now();
+  const long matched =
+      cli::runScript(cli, argv[1], [&](std::size_t line, bool matched) {
+        lines++;
+        if (!matched) {
+          std::cerr << argv[1] << ":" << line << ": no command matched"
+                    << std::endl;
+        }
+      });
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  if (matched < 0) {
+    std::cerr << "could not read " << argv[1] << std::endl;
+    return 1;
+  }
+
+  std::cout << matched << "/" << lines << " lines matched in "
+            << elapsed.count() << " s ("
+            << static_cast<long>(lines / elapsed.count()) << " lines/s)"
+            << std::endl;
+  std::cout << "limits [" << minLimit << ", " << maxLimit << "], ratio "
+            << ratio << ", voltage " << voltage << std::endl;
+  return matched == static_cast<long>(lines) ? 0 : 2;
+}
@@ -0,0 +1,43 @@
+/* @file Prints the memory used by CLIs of different configs
+ *  Run with ./footprint
+ */
+
+#include <cstdio>
+
+#include <cli/cli.hpp>
+
+// A console for one peripheral with a handful of short commands
+struct PeripheralConfig : cli::DefaultConfig {
+  static constexpr std::size_t cmdCountMax = 4;
+  static constexpr std::size_t schemasCountMax = 3;
+  static constexpr std::size_t cmdTokensMax = 4;
+  static constexpr std::size_t trieNodesMax = 8;
+  static constexpr std::size_t argMaxTextLen = 8;
+  static constexpr std::size_t helpTextMax = 96;
+};
+
+// A debug console with many commands and long string arguments
+struct DebugConfig : cli::DefaultConfig {
+  using SizeT = uint16_t;
+  static constexpr std::size_t cmdCountMax = 512;
+  static constexpr std::size_t trieNodesMax = 2 * cmdCountMax;
+  static constexpr bool argTextView = true;
+};
+
+static_assert(cli::Footprint<PeripheralConfig>::total <= 2048,
+              "peripheral console exceeds its memory budget");
+
+template <typename Config> void report(const char *name) {
+  using F = cli::Footprint<Config>;
+  std::printf("%-12s %8zu %8zu %8zu %8zu %8zu %8zu\n", name, F::total,
+              F::commands, F::schemas, F::index, F::help, F::run);
+}
+
+int main() {
+  std::printf("%-12s %8s %8s %8s %8s %8s %8s\n", "config", "total",
+              "commands", "schemas", "index", "help", "run");
+  report<PeripheralConfig>("peripheral");
+  report<cli::DefaultConfig>("default");
+  report<DebugConfig>("debug");
+  return 0;
+}
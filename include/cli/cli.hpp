@@ -2,10 +2,66 @@
 #define CLI_HPP_
 
 #include <array>
-#include <cctype>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
 #include <cstdint>
 #include <cstring>
-#include <functional>
+#include <limits>
+#include <memory>
+#include <new>
+#include <optional>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#if !defined(CLI_TOKENIZER_SCALAR) && !defined(CLI_TOKENIZER_SWAR) &&         \
+    !defined(CLI_TOKENIZER_SSE2)
+#if defined(__SSE2__)
+#define CLI_TOKENIZER_SSE2 1
+#elif UINTPTR_MAX == UINT64_MAX && defined(__BYTE_ORDER__) &&                 \
+    __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define CLI_TOKENIZER_SWAR 1
+#else
+#define CLI_TOKENIZER_SCALAR 1
+#endif
+#endif
+
+#if defined(CLI_TOKENIZER_SSE2)
+#include <emmintrin.h>
+#endif
+
+#if (defined(__x86_64__) || defined(__i386__)) && __has_include(<x86intrin.h>)
+#include <x86intrin.h>
+#define CLI_HAS_TSC 1
+#endif
+
+// Numbers are parsed 8 digits at a time on 64 bit little endian targets
+#if UINTPTR_MAX == UINT64_MAX && defined(__BYTE_ORDER__) &&                   \
+    __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define CLI_DIGITS_SWAR 1
+#endif
+
+#if defined(__has_include)
+#if __has_include(<charconv>)
+#include <charconv>
+#endif
+#endif
+#if !defined(__cpp_lib_to_chars)
+#include <cstdlib>
+#endif
+
+// With C++20, CLIs whose callbacks and schema parsers are plain function
+// pointers can be built in constant expressions, see BasicCLI
+#if defined(__cpp_lib_is_constant_evaluated) && defined(__cpp_constexpr) &&    \
+    __cpp_constexpr >= 201907L
+#define CLI_HAS_CONSTEXPR_TABLES 1
+#define CLI_CONSTEXPR constexpr
+#else
+#define CLI_CONSTEXPR
+#endif
 
 #define CLI_LOG_NOOP(format, ...)                                              \
   do {                                                                         \
@@ -40,6 +96,12 @@
 #define CLI_CMD_TOKENS_MAX 16
 #endif
 
+// Distinct choice and sized integer placeholders per command, see
+// PlaceholderFormat
+#ifndef CLI_CMD_FORMATS_MAX
+#define CLI_CMD_FORMATS_MAX 2
+#endif
+
 #ifndef CLI_ARG_MAX_TEXT_LEN
 #define CLI_ARG_MAX_TEXT_LEN 16
 #endif
@@ -48,19 +110,139 @@
 #define CLI_SIZE_T_TYPE uint8_t
 #endif
 
+// The tokenizer classifies 16 bytes at a time with SSE2, or 8 bytes at a time
+// on other 64 bit little endian targets, and uses a table otherwise. Define
+// one of CLI_TOKENIZER_SSE2, CLI_TOKENIZER_SWAR or CLI_TOKENIZER_SCALAR to
+// override the choice.
+// #define CLI_TOKENIZER_SCALAR
+
+// Define CLI_ARG_TEXT_VIEW to make string arguments point into the input
+// instead of copying them into the Argument. The views are valid until the
+// callback returns, and are not null terminated.
+// #define CLI_ARG_TEXT_VIEW
+
+// Bytes available for the captures of callbacks and schema parsers
+#ifndef CLI_FUNCTION_STORAGE_SIZE
+#define CLI_FUNCTION_STORAGE_SIZE (4 * sizeof(void *))
+#endif
+
+// Number of nodes in the literal prefix trie used for dispatch. Commands whose
+// literal prefix doesn't fit are still matched, just from a shallower node.
+#ifndef CLI_TRIE_NODES_MAX
+#define CLI_TRIE_NODES_MAX (2 * CLI_CMD_COUNT_MAX)
+#endif
+
+// Bytes of the help text precomputed at registration, so help is a single
+// write. Tables whose help doesn't fit write it command by command instead.
+#ifndef CLI_HELP_TEXT_MAX
+#define CLI_HELP_TEXT_MAX (16 * CLI_CMD_COUNT_MAX)
+#endif
+
+// Entries of the cache of recently matched commands, 0 disables it. See
+// CommandCache.
+#ifndef CLI_COMMAND_CACHE_SIZE
+#define CLI_COMMAND_CACHE_SIZE 0
+#endif
+
+// Command groups per CLI, see BasicCLI::withGroup
+#ifndef CLI_GROUP_COUNT_MAX
+#define CLI_GROUP_COUNT_MAX 4
+#endif
+
+// Define CLI_STATS to count hits, rejections and latencies in every CLI of the
+// default config, see Stats.
+// #define CLI_STATS
+
 namespace cli {
 
-using SizeT = CLI_SIZE_T_TYPE;
-template <typename T, SizeT N> class FixedVector {
+namespace detail {
+// Whether a table is being built in a constant expression
+constexpr bool constantEvaluated() {
+#ifdef CLI_HAS_CONSTEXPR_TABLES
+  return std::is_constant_evaluated();
+#else
+  return false;
+#endif
+}
+} // namespace detail
+
+/* Clocks for Stats. Any type with a static now() returning ticks works, ie.
+ * the cycle counter of a microcontroller.
+ */
+struct SteadyClock {
+  static uint64_t now() {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch())
+            .count());
+  }
+};
+
+#ifdef CLI_HAS_TSC
+struct TscClock {
+  static uint64_t now() { return __rdtsc(); }
+};
+#endif
+
+/* @struct DefaultConfig
+ * Capacities and storage of a BasicCLI. The CLI_* macros only set these
+ * defaults. A CLI with other limits derives its own config and overrides what
+ * it needs, ie.
+ *   struct SmallConfig : cli::DefaultConfig {
+ *     static constexpr std::size_t cmdCountMax = 4;
+ *     static constexpr std::size_t trieNodesMax = 8;
+ *   };
+ *   using SmallCLI = cli::BasicCLI<SmallConfig>;
+ * so every CLI in a binary only pays for its own tables.
+ */
+struct DefaultConfig {
+  // Index type of the tables, must hold every capacity below
+  using SizeT = CLI_SIZE_T_TYPE;
+  static constexpr std::size_t cmdCountMax = CLI_CMD_COUNT_MAX;
+  static constexpr std::size_t schemasCountMax = CLI_SCHEMAS_COUNT_MAX;
+  static constexpr std::size_t cmdTokensMax = CLI_CMD_TOKENS_MAX;
+  static constexpr std::size_t cmdFormatsMax = CLI_CMD_FORMATS_MAX;
+  // Usually twice cmdCountMax, raise it along with cmdCountMax
+  static constexpr std::size_t trieNodesMax = CLI_TRIE_NODES_MAX;
+  static constexpr std::size_t functionStorageSize = CLI_FUNCTION_STORAGE_SIZE;
+  // Size of the copy of string arguments, including the null
+  static constexpr std::size_t argMaxTextLen = CLI_ARG_MAX_TEXT_LEN;
+  static constexpr std::size_t helpTextMax = CLI_HELP_TEXT_MAX;
+  static constexpr std::size_t commandCacheSize = CLI_COMMAND_CACHE_SIZE;
+  static constexpr std::size_t groupCountMax = CLI_GROUP_COUNT_MAX;
+#ifdef CLI_ARG_TEXT_VIEW
+  static constexpr bool argTextView = true;
+#else
+  static constexpr bool argTextView = false;
+#endif
+  // Collect Stats, timed with StatsClock
+#ifdef CLI_STATS
+  static constexpr bool stats = true;
+#else
+  static constexpr bool stats = false;
+#endif
+  using StatsClock = SteadyClock;
+};
+
+using SizeT = DefaultConfig::SizeT;
+template <typename T, std::size_t N, typename Size = SizeT> class FixedVector {
+  static_assert(N <= std::numeric_limits<Size>::max(),
+                "SizeT of the config is too small for the capacity");
+
   std::array<T, N> m_array;
-  SizeT m_len = 0;
+  Size m_len = 0;
 
 public:
-  SizeT size() const { return m_len; }
+  using value_type = T;
+
+  CLI_CONSTEXPR Size size() const { return m_len; }
+
+  CLI_CONSTEXPR void clear() { m_len = 0; }
 
-  void clear() { m_len = 0; }
+  // Keeps the first len elements, len must not exceed the size
+  CLI_CONSTEXPR void resize(Size len) { m_len = len; }
 
-  bool push_back(T value) {
+  CLI_CONSTEXPR bool push_back(const T &value) {
     if (m_len >= N) {
       return false;
     }
@@ -69,28 +251,306 @@ public:
     return true;
   }
 
-  const T &operator[](SizeT i) const { return m_array[i]; }
-  T &operator[](SizeT i) { return m_array[i]; }
+  CLI_CONSTEXPR const T &operator[](Size i) const { return m_array[i]; }
+  CLI_CONSTEXPR T &operator[](Size i) { return m_array[i]; }
+};
+
+/* @class InplaceFunction
+ * Replacement for std::function which stores the callable inside the object
+ * and never allocates. Callables larger than N bytes fail to compile. Plain
+ * function pointers, alone or bound to a context pointer, are also stored in
+ * constant expressions.
+ */
+template <typename Sig, std::size_t N = DefaultConfig::functionStorageSize>
+class InplaceFunction;
+
+template <typename R, typename... A, std::size_t N>
+class InplaceFunction<R(A...), N> {
+  enum class Op { copy, move, destroy };
+  using Invoke = R (*)(void *, A &&...);
+  using Manage = void (*)(Op, void *, const void *);
+
+  struct Bound {
+    R (*function)(const void *, A...);
+    const void *context;
+  };
+
+  union {
+    alignas(std::max_align_t) unsigned char m_storage[N] = {};
+    R (*m_pointer)(A...);
+    Bound m_bound;
+  };
+  Invoke m_invoke = nullptr;
+  // nullptr for trivially copyable callables, which are copied bytewise
+  Manage m_manage = nullptr;
+
+  static R invokePointer(void *storage, A &&...args) {
+    return (*static_cast<R (**)(A...)>(storage))(std::forward<A>(args)...);
+  }
+  static R invokeBound(void *storage, A &&...args) {
+    const Bound &bound = *static_cast<const Bound *>(storage);
+    return bound.function(bound.context, std::forward<A>(args)...);
+  }
+
+  // @param op is copy, or move if other is an rvalue
+  CLI_CONSTEXPR void assign(const InplaceFunction &other, Op op) {
+    m_invoke = other.m_invoke;
+    m_manage = other.m_manage;
+    if (detail::constantEvaluated()) {
+      // only function pointers are stored in constant expressions
+      if (m_invoke == &invokeBound) {
+        m_bound = other.m_bound;
+      } else if (m_invoke != nullptr) {
+        m_pointer = other.m_pointer;
+      }
+    } else if (m_manage == nullptr) {
+      std::memcpy(m_storage, other.m_storage, N);
+    } else {
+      m_manage(op, m_storage, other.m_storage);
+    }
+  }
+
+  CLI_CONSTEXPR void reset() {
+    if (m_manage != nullptr) {
+      m_manage(Op::destroy, m_storage, nullptr);
+    }
+    m_invoke = nullptr;
+    m_manage = nullptr;
+  }
+
+public:
+  InplaceFunction() = default;
+  CLI_CONSTEXPR InplaceFunction(std::nullptr_t) {}
+  CLI_CONSTEXPR InplaceFunction(R (*f)(A...)) {
+    if (f != nullptr) {
+      m_pointer = f;
+      m_invoke = &invokePointer;
+    }
+  }
+  // f called with context as its first argument
+  CLI_CONSTEXPR InplaceFunction(R (*f)(const void *, A...),
+                                const void *context) {
+    static_assert(sizeof(Bound) <= N,
+                  "callable is too large, increase CLI_FUNCTION_STORAGE_SIZE");
+    if (f != nullptr) {
+      m_bound = Bound{f, context};
+      m_invoke = &invokeBound;
+    }
+  }
+
+  template <typename F, typename T = std::decay_t<F>,
+            typename = std::enable_if_t<
+                !std::is_same<T, InplaceFunction>::value &&
+                std::is_invocable_r<R, T &, A...>::value>>
+  InplaceFunction(F &&f) {
+    static_assert(sizeof(T) <= N,
+                  "callable is too large, increase CLI_FUNCTION_STORAGE_SIZE");
+    static_assert(alignof(T) <= alignof(std::max_align_t),
+                  "callable is over-aligned");
+    // function references decay to pointers too, but are never null
+    if constexpr (std::is_pointer<std::remove_reference_t<F>>::value) {
+      if (f == nullptr) {
+        return;
+      }
+    }
+
+    ::new (static_cast<void *>(m_storage)) T(std::forward<F>(f));
+    m_invoke = [](void *storage, A &&...args) -> R {
+      return (*static_cast<T *>(storage))(std::forward<A>(args)...);
+    };
+    if constexpr (!std::is_trivially_copyable<T>::value) {
+      m_manage = [](Op op, void *dst, const void *src) {
+        if (op == Op::copy) {
+          ::new (dst) T(*static_cast<const T *>(src));
+        } else if (op == Op::move) {
+          T &from = *static_cast<T *>(const_cast<void *>(src));
+          ::new (dst) T(std::move(from));
+        } else {
+          static_cast<T *>(dst)->~T();
+        }
+      };
+    }
+  }
+
+  CLI_CONSTEXPR InplaceFunction(const InplaceFunction &other) {
+    assign(other, Op::copy);
+  }
+  CLI_CONSTEXPR InplaceFunction(InplaceFunction &&other) {
+    assign(other, Op::move);
+  }
+
+  CLI_CONSTEXPR InplaceFunction &operator=(const InplaceFunction &other) {
+    if (this != &other) {
+      reset();
+      assign(other, Op::copy);
+    }
+    return *this;
+  }
+  CLI_CONSTEXPR InplaceFunction &operator=(InplaceFunction &&other) {
+    if (this != &other) {
+      reset();
+      assign(other, Op::move);
+    }
+    return *this;
+  }
+
+  CLI_CONSTEXPR ~InplaceFunction() { reset(); }
+
+  R operator()(A... args) const {
+    return m_invoke(const_cast<unsigned char *>(m_storage),
+                    std::forward<A>(args)...);
+  }
+
+  CLI_CONSTEXPR explicit operator bool() const { return m_invoke != nullptr; }
+  CLI_CONSTEXPR bool operator==(std::nullptr_t) const {
+    return m_invoke == nullptr;
+  }
+  CLI_CONSTEXPR bool operator!=(std::nullptr_t) const {
+    return m_invoke != nullptr;
+  }
+};
+
+/* @class FunctionRef
+ * Non-owning reference to a callable, for callables which only need to live
+ * for the duration of a call such as the help writer.
+ */
+template <typename Sig> class FunctionRef;
+
+template <typename R, typename... A> class FunctionRef<R(A...)> {
+  void *m_callable = nullptr;
+  R (*m_invoke)(void *, A &&...) = nullptr;
+
+public:
+  template <typename F, typename T = std::remove_reference_t<F>,
+            typename = std::enable_if_t<
+                !std::is_same<std::decay_t<F>, FunctionRef>::value &&
+                std::is_invocable_r<R, T &, A...>::value>>
+  FunctionRef(F &&f)
+      : m_callable(const_cast<void *>(
+            static_cast<const void *>(std::addressof(f)))),
+        m_invoke([](void *callable, A &&...args) -> R {
+          return (*static_cast<T *>(callable))(std::forward<A>(args)...);
+        }) {}
+
+  R operator()(A... args) const {
+    return m_invoke(m_callable, std::forward<A>(args)...);
+  }
 };
 
-class Argument;
-// using Arguments = std::array<Argument, CLI_CMD_TOKENS_MAX>;
-using Arguments = FixedVector<Argument, CLI_CMD_TOKENS_MAX>;
-using Callback = std::function<void(Arguments)>;
-class Command;
-// std::array<Command, CLI_CMD_COUNT_MAX>;
-using Commands = FixedVector<Command, CLI_CMD_COUNT_MAX>;
 class Token;
-using Tokens = FixedVector<Token, CLI_CMD_TOKENS_MAX>;
-class Schema;
-using Schemas = FixedVector<Schema, CLI_SCHEMAS_COUNT_MAX>;
-using TokenParser = std::function<bool(const Token &, Argument &)>;
+class OutputSink;
+template <typename Config> class BasicArgument;
+template <typename Config> class BasicSchema;
+template <typename Config> class BasicCommand;
+template <typename Config> class BasicCommandIndex;
+template <typename Config> class BasicCLI;
+template <typename Config> class BasicCompleter;
+
+/* @class CommandCallback
+ * Callback of a command, called with the arguments and the output sink of
+ * the run. Callables which only take the arguments are accepted too.
+ */
+template <typename Arguments, std::size_t N> class CommandCallback {
+  InplaceFunction<void(const Arguments &, OutputSink &), N> m_function;
+
+public:
+  CommandCallback() = default;
+  CLI_CONSTEXPR CommandCallback(std::nullptr_t) {}
+  // plain function pointers keep tables constexpr, see BasicCLI
+  CLI_CONSTEXPR CommandCallback(void (*f)(const Arguments &, OutputSink &))
+      : m_function(f) {}
+  CLI_CONSTEXPR CommandCallback(void (*f)(const void *, const Arguments &,
+                                          OutputSink &),
+                                const void *context)
+      : m_function(f, context) {}
+
+  template <typename F, typename T = std::decay_t<F>,
+            typename = std::enable_if_t<
+                !std::is_same<T, CommandCallback>::value &&
+                std::is_invocable<T &, const Arguments &, OutputSink &>::value>>
+  CommandCallback(F &&f) : m_function(std::forward<F>(f)) {}
+
+  template <typename F, typename T = std::decay_t<F>,
+            typename = std::enable_if_t<
+                std::is_invocable<T &, const Arguments &>::value>,
+            typename = void>
+  CommandCallback(F &&f)
+      : m_function([f = T(std::forward<F>(f))](
+                       const Arguments &args, OutputSink &) mutable {
+          f(args);
+        }) {}
+
+  void operator()(const Arguments &args, OutputSink &out) const {
+    m_function(args, out);
+  }
+
+  CLI_CONSTEXPR explicit operator bool() const {
+    return static_cast<bool>(m_function);
+  }
+  CLI_CONSTEXPR bool operator==(std::nullptr_t) const {
+    return m_function == nullptr;
+  }
+  CLI_CONSTEXPR bool operator!=(std::nullptr_t) const {
+    return m_function != nullptr;
+  }
+};
+
+// Containers and callbacks sized by a config
+template <typename Config> struct Types {
+  using SizeT = typename Config::SizeT;
+  using Argument = BasicArgument<Config>;
+  using Arguments = FixedVector<Argument, Config::cmdTokensMax, SizeT>;
+  using Callback = CommandCallback<Arguments, Config::functionStorageSize>;
+  using Command = BasicCommand<Config>;
+  using Commands = FixedVector<Command, Config::cmdCountMax, SizeT>;
+  using Tokens = FixedVector<Token, Config::cmdTokensMax, SizeT>;
+  using Schema = BasicSchema<Config>;
+  using Schemas = FixedVector<Schema, Config::schemasCountMax, SizeT>;
+  using TokenParser = InplaceFunction<bool(const Token &, Argument &),
+                                      Config::functionStorageSize>;
+  using Matcher = bool (*)(const Tokens &, Arguments &);
+  using Writer =
+      InplaceFunction<void(const char *, int), Config::functionStorageSize>;
+};
+
+using Argument = Types<DefaultConfig>::Argument;
+using Arguments = Types<DefaultConfig>::Arguments;
+using Callback = Types<DefaultConfig>::Callback;
+using Command = Types<DefaultConfig>::Command;
+using Commands = Types<DefaultConfig>::Commands;
+using Tokens = Types<DefaultConfig>::Tokens;
+using Schema = Types<DefaultConfig>::Schema;
+using Schemas = Types<DefaultConfig>::Schemas;
+using TokenParser = Types<DefaultConfig>::TokenParser;
+using Matcher = Types<DefaultConfig>::Matcher;
+using CommandIndex = BasicCommandIndex<DefaultConfig>;
+using CLI = BasicCLI<DefaultConfig>;
+using HelpWriter = FunctionRef<void(const char *, int)>;
+using ResultSink = FunctionRef<void(std::size_t line, bool matched)>;
+using CompletionSink = FunctionRef<void(const Token &candidate)>;
 
 namespace parsers {
+enum class ParseError : uint8_t { none, invalid, outOfRange };
+namespace detail {
+// Escaped numbers longer than this are rejected instead of unescaped
+constexpr std::size_t numberScratch = 64;
+} // namespace detail
 bool parseInteger(const Token &token, int &value);
+bool parseInteger(const Token &token, int &value, ParseError &error);
 bool parseFloat(const Token &token, float &value);
+bool parseFloat(const Token &token, float &value, ParseError &error);
 bool tokenSplitter(const char *input, SizeT &tokenStart, SizeT &tokenLen);
+bool tokenSplitter(const char *input, std::size_t inputLen,
+                   std::size_t &tokenStart, std::size_t &tokenLen);
+Token unquote(const Token &span);
+template <typename Tokens> Tokens tokenize(const char *str, std::size_t len);
+template <typename Tokens>
+Tokens tokenize(const char *str, std::size_t len, bool &truncated);
+template <typename Tokens>
+Tokens tokenize(const char *str, std::size_t len, bool &truncated,
+                bool &malformed);
 Tokens tokenParser(const char *str);
+Tokens tokenParser(const char *str, std::size_t len);
 Argument argumentParser(const Schemas &schemas, const Token &token,
                         const Token &inputToken);
 } // namespace parsers
@@ -101,6 +561,14 @@ constexpr Tag tagInvalid = 0;
 constexpr Tag tagInt = tagInvalid + 1;
 constexpr Tag tagFloat = tagInt + 1;
 constexpr Tag tagString = tagFloat + 1;
+// integers of a fixed width, see IntegerFormat. 32 bit signed ones are tagInt
+constexpr Tag tagInt8 = tagString + 1;
+constexpr Tag tagUInt8 = tagInt8 + 1;
+constexpr Tag tagInt16 = tagUInt8 + 1;
+constexpr Tag tagUInt16 = tagInt16 + 1;
+constexpr Tag tagUInt32 = tagUInt16 + 1;
+constexpr Tag tagInt64 = tagUInt32 + 1;
+constexpr Tag tagUInt64 = tagInt64 + 1;
 
 // Tag identifiers to use with custom schemas
 constexpr Tag tagUser1 = 100;
@@ -111,419 +579,3831 @@ constexpr Tag tagUser3 = tagUser2 + 1;
 namespace str {
 bool isInt(char c);
 int toInt(char c);
+bool isSpace(char c);
+const char *findDelimiter(const char *begin, const char *end);
+const char *skipSpace(const char *begin, const char *end);
+bool isQuote(char c);
+const char *findQuote(const char *begin, const char *end, char quote,
+                      bool &escaped);
 } // namespace str
 
+// Why a line or an argument was rejected
+enum class Rejection : uint8_t {
+  noMatch,     // no command has the literals of the line, or bad quotes
+  tokenLimit,  // more tokens than cmdTokensMax
+  schemaParse, // a placeholder didn't parse
+  tagMismatch, // get<T>(Tag) on an argument of another tag
+  count
+};
+
+// Stages of run which Stats times
+enum class Phase : uint8_t { tokenize, match, callback, count };
+
+/* @class Counter
+ * Relaxed atomic counter, copied with the CLI which owns it. Counting doesn't
+ * change the CLI, so const runs count too.
+ */
+class Counter {
+  mutable std::atomic<uint32_t> m_value{0};
+
+public:
+  Counter() = default;
+  Counter(const Counter &other) : m_value(other.load()) {}
+  Counter &operator=(const Counter &other) {
+    m_value.store(other.load(), std::memory_order_relaxed);
+    return *this;
+  }
+
+  void add() const { m_value.fetch_add(1, std::memory_order_relaxed); }
+  uint32_t load() const { return m_value.load(std::memory_order_relaxed); }
+};
+
+/* @class Stats
+ * Instrumentation of BasicCLI::run, enabled by Config::stats: hits per
+ * command, rejections per reason, and log2 histograms of the ticks of
+ * Config::StatsClock spent in every phase. Bucket b counts durations in
+ * [2^(b - 1), 2^b) ticks, bucket 0 durations of 0 ticks. Counters are atomic,
+ * so concurrent runs are counted correctly. Tag mismatches happen in
+ * callbacks, which don't know their CLI, so they are counted per config.
+ */
+template <typename Config> class Stats {
+public:
+  static constexpr std::size_t buckets = 32;
+  using Histogram = std::array<Counter, buckets>;
+
+private:
+  std::array<Counter, Config::cmdCountMax> m_hits;
+  std::array<Counter, static_cast<std::size_t>(Rejection::count)> m_rejections;
+  std::array<Histogram, static_cast<std::size_t>(Phase::count)> m_latency;
+  static inline Counter s_tagMismatches;
+
+public:
+  static uint64_t now() { return Config::StatsClock::now(); }
+
+  static void tagMismatch() { s_tagMismatches.add(); }
+
+  void hit(std::size_t command) const { m_hits[command].add(); }
+
+  void reject(Rejection reason) const {
+    m_rejections[static_cast<std::size_t>(reason)].add();
+  }
+
+  void record(Phase phase, uint64_t start) const {
+    const uint64_t ticks = now() - start;
+    std::size_t bucket =
+        ticks == 0 ? 0 : 64 - static_cast<std::size_t>(__builtin_clzll(ticks));
+    if (bucket >= buckets) {
+      bucket = buckets - 1;
+    }
+    m_latency[static_cast<std::size_t>(phase)][bucket].add();
+  }
+
+  uint32_t hits(std::size_t command) const { return m_hits[command].load(); }
+
+  uint32_t rejections(Rejection reason) const {
+    if (reason == Rejection::tagMismatch) {
+      return s_tagMismatches.load();
+    }
+    return m_rejections[static_cast<std::size_t>(reason)].load();
+  }
+
+  const Histogram &latency(Phase phase) const {
+    return m_latency[static_cast<std::size_t>(phase)];
+  }
+};
+
+// Stats compiled out, every call is a no-op
+template <typename Config> class NoStats {
+public:
+  static uint64_t now() { return 0; }
+  static void tagMismatch() {}
+  void hit(std::size_t) const {}
+  void reject(Rejection) const {}
+  void record(Phase, uint64_t) const {}
+};
+
 /* @class Token
  * Represent a token (aka a substring of either the command definition
  * or the input string.
  */
 class Token {
+  // the top bits of m_len mark quoted tokens, Token stays two words
+  static constexpr std::size_t escapedBit = ~(~std::size_t(0) >> 1);
+  static constexpr std::size_t quotedBit = escapedBit >> 1;
+  static constexpr std::size_t flags = escapedBit | quotedBit;
+
   const char *m_raw = nullptr;
-  SizeT m_len = 0;
+  std::size_t m_len = 0;
 
 public:
   Token() = default;
-  Token(const char *str, SizeT len) : m_raw(str), m_len(len) {}
+  constexpr Token(const char *str, std::size_t len) : m_raw(str), m_len(len) {}
+  constexpr Token(const char *str, std::size_t len, bool escaped,
+                  bool quoted = false)
+      : m_raw(str), m_len(len | (escaped ? escapedBit : 0) |
+                          (quoted ? quotedBit : 0)) {}
 
-  const char *str() const { return m_raw; }
-  SizeT len() const { return m_len; }
+  constexpr const char *str() const { return m_raw; }
+  constexpr std::size_t len() const { return m_len & ~flags; }
 
-  bool isValid() const { return m_raw != nullptr && m_len > 0; }
+  /* Quoted tokens with backslash escapes. str() is the raw text between the
+   * quotes, unescape gives the value.
+   */
+  constexpr bool escaped() const { return (m_len & escapedBit) != 0; }
 
-  bool operator==(const Token &other) const {
-    if (len() != other.len()) {
-      return false;
-    }
+  // Tokens between closing quotes, the quotes are next to str()
+  constexpr bool quoted() const { return (m_len & quotedBit) != 0; }
 
-    for (SizeT i = 0; i < len(); i++) {
-      if (str()[i] != other.str()[i]) {
-        return false;
+  /* Copies the value of the token into out, where a backslash takes the next
+   * character literally in escaped tokens.
+   * @return number of characters written, at most cap
+   */
+  std::size_t unescape(char *out, std::size_t cap) const {
+    const std::size_t rawLen = len();
+    if (!escaped()) {
+      const std::size_t n = rawLen < cap ? rawLen : cap;
+      if (n > 0) {
+        std::memcpy(out, m_raw, n);
+      }
+      return n;
+    }
+    std::size_t n = 0;
+    for (std::size_t i = 0; i < rawLen && n < cap; i++, n++) {
+      if (m_raw[i] == '\\' && i + 1 < rawLen) {
+        i++;
       }
+      out[n] = m_raw[i];
     }
+    return n;
+  }
 
-    return true;
+  constexpr bool isValid() const { return m_raw != nullptr && len() > 0; }
+
+  // Escaped tokens only equal escaped tokens with the same raw text
+  CLI_CONSTEXPR bool operator==(const Token &other) const {
+    return (m_len & ~quotedBit) == (other.m_len & ~quotedBit) &&
+           (len() == 0 ||
+            std::char_traits<char>::compare(str(), other.str(), len()) == 0);
   }
 };
 
-class Schema {
-  Token m_pattern;
-  TokenParser m_parser = nullptr;
+/* @class OutputSink
+ * Output of help and callbacks, collected in a buffer and passed on to the
+ * writer in large chunks, when the buffer is full and on flush. Writes which
+ * don't fit into the empty buffer go to the writer directly. A default
+ * constructed sink discards its output, see BufferedOutput for a sink with a
+ * buffer.
+ */
+class OutputSink {
+public:
+  using Writer = InplaceFunction<void(const char *, int)>;
+
+private:
+  char *m_buffer = nullptr;
+  std::size_t m_size = 0;
+  std::size_t m_len = 0;
+  Writer m_writer;
+
+protected:
+  OutputSink(char *buffer, std::size_t size, Writer writer)
+      : m_buffer(buffer), m_size(size), m_writer(writer) {}
 
 public:
-  Schema() = default;
-  Schema(const char *pattern, TokenParser parser)
-      : m_pattern(pattern, std::strlen(pattern)), m_parser(parser) {}
+  OutputSink() = default;
+  OutputSink(const OutputSink &) = delete;
+  OutputSink &operator=(const OutputSink &) = delete;
 
-  bool isSchema(const Token &commandToken) const {
-    return m_pattern == commandToken;
+  void write(const char *text, std::size_t len) {
+    if (m_writer == nullptr || len == 0) {
+      return;
+    }
+    if (len > m_size - m_len) {
+      flush();
+      if (len >= m_size) {
+        m_writer(text, static_cast<int>(len));
+        return;
+      }
+    }
+    std::memcpy(m_buffer + m_len, text, len);
+    m_len += len;
   }
+  void write(const char *text) { write(text, std::strlen(text)); }
+  void write(const Token &token) { write(token.str(), token.len()); }
+  void put(char c) { write(&c, 1); }
 
-  bool parse(const Token &inputToken, Argument &arg) const {
-    if (m_parser == nullptr) {
-      return false;
+  // Writer interface, so a sink can be passed as a HelpWriter
+  void operator()(const char *text, int len) {
+    write(text, static_cast<std::size_t>(len));
+  }
+
+  void flush() {
+    if (m_len > 0) {
+      m_writer(m_buffer, static_cast<int>(m_len));
+      m_len = 0;
     }
-    return m_parser(inputToken, arg);
   }
+
+  // Bytes written since the last flush
+  std::size_t pending() const { return m_len; }
 };
 
-/* @class Argument is a tagged union wrapping multiple
- * types of parsed data.
+/* @class BufferedOutput
+ * OutputSink with a buffer of N bytes, flushed when it goes out of scope, ie.
+ *   cli::BufferedOutput<64> out([](const char *text, int len) {
+ *     uart_write(text, len);
+ *   });
+ *   cli.run(line, out);
  */
-class Argument {
+template <std::size_t N> class BufferedOutput : public OutputSink {
+  char m_storage[N];
+
 public:
-  Tag m_tag = constants::tagInvalid;
+  explicit BufferedOutput(Writer writer) : OutputSink(m_storage, N, writer) {}
+  ~BufferedOutput() { flush(); }
+};
 
-  union Data {
-    char text[CLI_ARG_MAX_TEXT_LEN] = {0};
-    int integer;
-    float decimal;
-    uint64_t raw64;
-  };
-  Data m_value = {};
+/* @class CommandCache
+ * Recently matched commands of a CLI keyed on a hash of their literal
+ * prefix, enabled by Config::commandCacheSize. Lines whose leading tokens hash
+ * like an entry try its command before the dispatch index. Only commands
+ * which no earlier command can shadow are cached, so a hit which parses is
+ * the command the index would find. New entries replace the last one and
+ * every hit moves its entry one ahead, so frequent commands stay in front.
+ * Entries are atomic and lookups don't wait. Inserts and moves are claimed
+ * with a flag, and a run which finds it taken skips them, so concurrent runs
+ * can't duplicate or drop entries.
+ */
+template <typename Config> class CommandCache {
+  using SizeT = typename Config::SizeT;
+  using Tokens = typename Types<Config>::Tokens;
+  static constexpr std::size_t size = Config::commandCacheSize;
+  static_assert(Config::cmdCountMax < (1u << 24) &&
+                    Config::cmdTokensMax < (1u << 8),
+                "cache entries hold 24 bit commands and 8 bit prefixes");
 
-public:
-  Argument() = default;
+  // hash << 32 | prefix length << 24 | command + 1, 0 is an empty entry
+  mutable std::array<std::atomic<uint64_t>, size> m_entries = {};
+  // set while a run writes entries
+  mutable std::atomic<bool> m_writing{false};
+  std::array<bool, Config::cmdCountMax> m_cacheable = {};
+  Counter m_hits;
+  Counter m_misses;
 
-  bool isValid() const { return m_tag != constants::tagInvalid; }
+  /* Mixes the length and the first and last four bytes of a token into h.
+   * Tokens which only differ in the middle collide, which costs a parse.
+   */
+  static uint64_t hash(uint64_t h, const Token &token) {
+    const char *const str = token.str();
+    const std::size_t len = token.len();
+    uint64_t word = len;
+    if (len >= 4) {
+      uint32_t head;
+      uint32_t tail;
+      std::memcpy(&head, str, 4);
+      std::memcpy(&tail, str + len - 4, 4);
+      word ^= static_cast<uint64_t>(head) << 8 ^ static_cast<uint64_t>(tail)
+                                                     << 32;
+    } else {
+      for (std::size_t i = 0; i < len; i++) {
+        word |= static_cast<uint64_t>(static_cast<uint8_t>(str[i]))
+                << (8 * (i + 1));
+      }
+    }
+    h = (h ^ word) * 0x9e3779b97f4a7c15u;
+    return h ^ (h >> 32);
+  }
+  static constexpr uint64_t seed = 0;
 
-  Tag getTag() const { return m_tag; }
+  // @return false if another run is writing, the caller skips its write
+  bool lock() const {
+    return !m_writing.exchange(true, std::memory_order_acquire);
+  }
+  void unlock() const { m_writing.store(false, std::memory_order_release); }
 
-  template <typename T> static Argument create(Tag tag, T value) {
-    T *valuePtr = &value;
-    uint64_t *rawPtr = (uint64_t *)(valuePtr);
+public:
+  static constexpr SizeT none = std::numeric_limits<SizeT>::max();
 
-    Argument a;
-    a.m_tag = tag;
-    a.m_value.raw64 = *rawPtr;
-    return a;
+  CommandCache() = default;
+  CommandCache(const CommandCache &other) { *this = other; }
+  CommandCache &operator=(const CommandCache &other) {
+    for (std::size_t i = 0; i < size; i++) {
+      m_entries[i].store(other.m_entries[i].load(std::memory_order_relaxed),
+                         std::memory_order_relaxed);
+    }
+    m_cacheable = other.m_cacheable;
+    m_hits = other.m_hits;
+    m_misses = other.m_misses;
+    return *this;
   }
 
-  template <typename T> T get() const {
-    T *ptr = (T *)(&m_value.raw64);
-    return *ptr;
+  void setCacheable(SizeT command, bool cacheable) {
+    m_cacheable[command] = cacheable;
   }
 
-  template <typename T> T get(Tag tag) const {
-    if (m_tag != tag) {
-      CLI_WARN("get on non matching tag");
-      return T();
+  void clear() {
+    for (auto &entry : m_entries) {
+      entry.store(0, std::memory_order_relaxed);
     }
-    const uint64_t *rawPtr = &m_value.raw64;
-    const T *ptr = (T *)(rawPtr);
-    return *ptr;
   }
 
-  static Argument text(const Token &token) {
-    Argument a;
-    a.m_tag = constants::tagString;
-    strncpy(a.m_value.text, token.str(), token.len());
-    return a;
+  /* @param slot is set to the entry of the command, for hit
+   * @return the cached command for the line, or none
+   */
+  SizeT find(const Tokens &tokens, std::size_t &slot) const {
+    std::array<uint64_t, Config::cmdTokensMax + 1> hashes;
+    hashes[0] = seed;
+    std::size_t hashed = 0;
+    for (std::size_t i = 0; i < size; i++) {
+      const uint64_t entry = m_entries[i].load(std::memory_order_relaxed);
+      const std::size_t len = (entry >> 24) & 0xff;
+      if (entry == 0 || len > tokens.size()) {
+        continue;
+      }
+      for (; hashed < len; hashed++) {
+        hashes[hashed + 1] = hash(hashes[hashed], tokens[hashed]);
+      }
+      if (static_cast<uint32_t>(hashes[len]) ==
+          static_cast<uint32_t>(entry >> 32)) {
+        slot = i;
+        return static_cast<SizeT>((entry & 0xffffff) - 1);
+      }
+    }
+    return none;
   }
 
-  const char *getString() const {
-    if (m_tag != constants::tagString) {
-      CLI_WARN("trying to get non-word argument as word\n");
-      return "";
+  void hit(std::size_t slot) const {
+    m_hits.add();
+    if (slot == 0 || !lock()) {
+      return;
     }
+    const uint64_t entry = m_entries[slot].load(std::memory_order_relaxed);
+    m_entries[slot].store(m_entries[slot - 1].load(std::memory_order_relaxed),
+                          std::memory_order_relaxed);
+    m_entries[slot - 1].store(entry, std::memory_order_relaxed);
+    unlock();
+  }
 
-    return m_value.text;
+  void miss() const { m_misses.add(); }
+
+  // Caches command for lines starting with its literal prefix of len tokens
+  void insert(const Tokens &tokens, SizeT command, std::size_t len) const {
+    if (!m_cacheable[command]) {
+      return;
+    }
+    uint64_t h = seed;
+    for (std::size_t i = 0; i < len; i++) {
+      h = hash(h, tokens[i]);
+    }
+    const uint64_t entry = static_cast<uint64_t>(static_cast<uint32_t>(h))
+                               << 32 |
+                           static_cast<uint64_t>(len) << 24 |
+                           (static_cast<uint64_t>(command) + 1);
+    if (!lock()) {
+      return;
+    }
+    // another run may have inserted the command since this one missed
+    std::size_t slot = size - 1;
+    for (std::size_t i = 0; i < size; i++) {
+      const uint64_t current = m_entries[i].load(std::memory_order_relaxed);
+      if (current == entry) {
+        slot = size;
+        break;
+      }
+      if (current == 0) {
+        slot = i;
+        break;
+      }
+    }
+    if (slot < size) {
+      m_entries[slot].store(entry, std::memory_order_relaxed);
+    }
+    unlock();
   }
 
-  // int getInt() const {
-  //   if (m_tag != Tag::integer) {
-  //     CLI_WARN("trying to get non-int argument as integer\n");
-  //     return 0;
-  //   }
+  // Command of the entry in slot, or none if it is empty
+  SizeT command(std::size_t slot) const {
+    const uint64_t entry = m_entries[slot].load(std::memory_order_relaxed);
+    return entry == 0 ? none : static_cast<SizeT>((entry & 0xffffff) - 1);
+  }
 
-  //   return m_value.integer;
-  // }
-  // float getFloat() const {
-  //   if (m_tag != Tag::decimal) {
-  //     CLI_WARN("trying to get non-float argument as float\n");
-  //     return 0.0;
-  //   }
+  uint32_t hits() const { return m_hits.load(); }
+  uint32_t misses() const { return m_misses.load(); }
+};
 
-  //   return m_value.decimal;
-  // }
+// Cache disabled, see CommandCache
+template <typename Config> class NoCommandCache {
+public:
+  CLI_CONSTEXPR void clear() {}
 };
 
-static const Schema schemaText("?s", [](const Token &input, Argument &result) {
-  result = Argument::text(input);
-  return true;
-});
+/* @class Choices
+ * Table of the words of a choice placeholder, ie. "?{on|off|blink}", which
+ * parses a word to its index. The words are hashed into slots once, with a
+ * multiplier picked so that no two words share a slot, so matching hashes
+ * the input and compares it with a single word whatever the number of
+ * words. The words are read from the placeholder, which must outlive the
+ * table.
+ */
+class Choices {
+public:
+  static constexpr std::size_t maxWords = 8;
 
-static const Schema schemaInteger("?i", [](const Token &input,
-                                           Argument &result) {
-  int value;
-  if (!parsers::parseInteger(input, value)) {
-    return false;
-  }
-  result = Argument::create(constants::tagInt, value);
-  return true;
-});
+private:
+  static constexpr std::size_t slotCount = 16;
+  // offset of the word in the placeholder, 0 for empty slots
+  std::array<uint8_t, slotCount> m_slots = {};
+  // hash multiplier, 0 without words
+  uint8_t m_seed = 0;
 
-static const Schema schemaFloat("?f", [](const Token &input, Argument &result) {
-  float value;
-  if (!parsers::parseFloat(input, value)) {
-    return false;
+  static constexpr std::size_t slot(uint32_t seed, const char *word,
+                                    std::size_t len) {
+    uint32_t h = static_cast<uint32_t>(len);
+    for (std::size_t i = 0; i < len; i++) {
+      h = h * (2 * seed + 1) + static_cast<uint8_t>(word[i]);
+    }
+    // the low bits only depend on the low bits of the bytes
+    return (h * 0x9e3779b1u) >> 28;
   }
-  result = Argument::create(constants::tagFloat, value);
-  return true;
-});
 
-namespace str {
-bool isInt(char c) { return '0' <= c && c <= '9'; }
-int toInt(char c) { return static_cast<int>(c - '0'); }
-} // namespace str
+  static constexpr bool isDelimiter(char c) { return c == '|' || c == '}'; }
 
-namespace parsers {
-bool parseInteger(const Token &token, int &value) {
-  if (!token.isValid()) {
-    return false;
+public:
+  static constexpr bool isChoice(const Token &token) {
+    return token.len() > 3 && token.str()[0] == '?' && token.str()[1] == '{' &&
+           token.str()[token.len() - 1] == '}';
   }
-  const char &first = *token.str();
-  const bool validFirst = first == '+' || first == '-' || str::isInt(first);
-  if (!validFirst) {
+
+  // Calls f with the offset and length of every word of pattern, in order
+  template <typename F>
+  static constexpr void forEachWord(const Token &pattern, F &&f) {
+    std::size_t start = 2;
+    for (std::size_t i = start; i < pattern.len(); i++) {
+      if (isDelimiter(pattern.str()[i])) {
+        f(start, i - start);
+        start = i + 1;
+      }
+    }
+  }
+
+  Choices() = default;
+  constexpr explicit Choices(const Token &pattern) {
+    CLI_ASSERT(isChoice(pattern) && pattern.len() <= 255,
+               "choice placeholders are ?{word|...}, at most 255 characters");
+    std::array<uint8_t, maxWords> words = {};
+    std::size_t count = 0;
+    forEachWord(pattern, [&](std::size_t offset, std::size_t len) {
+      CLI_ASSERT(len > 0, "choices can't be empty");
+      CLI_ASSERT(count < maxWords, "placeholder has more than %d choices",
+                 static_cast<int>(maxWords));
+      if (count < maxWords) {
+        words[count++] = static_cast<uint8_t>(offset);
+      }
+    });
+
+    for (uint32_t seed = 1; seed <= 255; seed++) {
+      std::array<uint8_t, slotCount> slots = {};
+      bool perfect = true;
+      for (std::size_t w = 0; w < count && perfect; w++) {
+        std::size_t len = 0;
+        while (!isDelimiter(pattern.str()[words[w] + len])) {
+          len++;
+        }
+        uint8_t &entry = slots[slot(seed, pattern.str() + words[w], len)];
+        perfect = entry == 0;
+        entry = words[w];
+      }
+      if (perfect) {
+        m_slots = slots;
+        m_seed = static_cast<uint8_t>(seed);
+        return;
+      }
+    }
+    CLI_ASSERT(false, "choices must be distinct");
+  }
+
+  /* @param pattern is the placeholder the table was built from
+   * @return index of the word input is, or -1
+   */
+  constexpr int find(const Token &pattern, const Token &input) const {
+    if (m_seed == 0) {
+      return -1;
+    }
+    const std::size_t len = input.len();
+    const std::size_t offset = m_slots[slot(m_seed, input.str(), len)];
+    if (offset == 0 || offset + len >= pattern.len() ||
+        !isDelimiter(pattern.str()[offset + len]) ||
+        std::char_traits<char>::compare(pattern.str() + offset, input.str(),
+                                        len) != 0) {
+      return -1;
+    }
+    // words are stored at increasing offsets
+    int index = 0;
+    for (std::size_t i = 0; i < slotCount; i++) {
+      index += m_slots[i] != 0 && m_slots[i] < offset ? 1 : 0;
+    }
+    return index;
+  }
+};
+
+/* @class IntegerFormat
+ * Integer placeholder of a fixed width with an optional range, ie. "?u8",
+ * "?u32" or "?i16[-100..100]", whose arguments keep their width. Input may
+ * be decimal, 0x hex or 0b binary, with a sign for signed formats. The
+ * digits are checked against the range as they are read, so overflowing
+ * input is rejected without reading it all.
+ */
+class IntegerFormat {
+  // bounds as uint64_t, in two's complement for signed formats. There are
+  // no initializers, so the format can share a union in PlaceholderFormat
+  uint64_t m_min;
+  uint64_t m_max;
+  Tag m_tag;
+  bool m_signed;
+
+  static constexpr uint8_t digit(char c) {
+    if ('0' <= c && c <= '9') {
+      return static_cast<uint8_t>(c - '0');
+    }
+    c = static_cast<char>(c | 0x20);
+    return 'a' <= c && c <= 'f' ? static_cast<uint8_t>(c - 'a' + 10) : 0xff;
+  }
+
+  /* Reads a number filling all of text, and stops at the first digit which
+   * takes its magnitude past the limit of its sign.
+   */
+  static constexpr bool read(const char *text, std::size_t len,
+                             uint64_t negativeLimit, uint64_t positiveLimit,
+                             uint64_t &magnitude, bool &negative) {
+    std::size_t i = 0;
+    negative = len > 0 && text[0] == '-';
+    if (len > 0 && (text[0] == '-' || text[0] == '+')) {
+      i++;
+    }
+    const uint64_t limit = negative ? negativeLimit : positiveLimit;
+    uint8_t base = 10;
+    if (len - i > 2 && text[i] == '0' && (text[i + 1] | 0x20) == 'x') {
+      base = 16;
+      i += 2;
+    } else if (len - i > 2 && text[i] == '0' && (text[i + 1] | 0x20) == 'b') {
+      base = 2;
+      i += 2;
+    }
+    if (i == len) {
+      return false;
+    }
+
+    magnitude = 0;
+    for (; i < len; i++) {
+      const uint8_t d = digit(text[i]);
+      if (d >= base || d > limit || magnitude > (limit - d) / base) {
+        return false;
+      }
+      magnitude = magnitude * base + d;
+    }
+    return true;
+  }
+
+  static constexpr uint64_t negate(uint64_t magnitude) {
+    return ~magnitude + 1;
+  }
+
+  // Whether value is in [m_min, m_max]
+  constexpr bool inRange(uint64_t value) const {
+    if (m_signed) {
+      return static_cast<int64_t>(m_min) <= static_cast<int64_t>(value) &&
+             static_cast<int64_t>(value) <= static_cast<int64_t>(m_max);
+    }
+    return m_min <= value && value <= m_max;
+  }
+
+  // Reads text within [m_min, m_max]
+  constexpr bool parse(const char *text, std::size_t len,
+                       uint64_t &value) const {
+    const bool negativeMin = m_signed && static_cast<int64_t>(m_min) < 0;
+    const bool negativeMax = m_signed && static_cast<int64_t>(m_max) < 0;
+    uint64_t magnitude = 0;
+    bool negative = false;
+    if (!read(text, len, negativeMin ? negate(m_min) : 0,
+              negativeMax ? 0 : m_max, magnitude, negative) ||
+        (negative && !m_signed)) {
+      return false;
+    }
+    value = negative ? negate(magnitude) : magnitude;
+    return inRange(value);
+  }
+
+public:
+  static constexpr bool isInteger(const Token &token) {
+    const char *const p = token.str();
+    const std::size_t len = token.len();
+    if (len < 3 || p[0] != '?' || (p[1] != 'i' && p[1] != 'u')) {
+      return false;
+    }
+    std::size_t width = 1;
+    if (p[2] != '8') {
+      width = 2;
+      if (len < 4 || !((p[2] == '1' && p[3] == '6') ||
+                       (p[2] == '3' && p[3] == '2') ||
+                       (p[2] == '6' && p[3] == '4'))) {
+        return false;
+      }
+    }
+    return len == 2 + width ||
+           (len > 3 + width && p[2 + width] == '[' && p[len - 1] == ']');
+  }
+
+  IntegerFormat() = default;
+  constexpr explicit IntegerFormat(const Token &pattern)
+      : m_min(0), m_max(0), m_tag(constants::tagInvalid), m_signed(false) {
+    CLI_ASSERT(isInteger(pattern), "integer placeholders are ?i or ?u and "
+                                   "8, 16, 32 or 64, with an optional "
+                                   "[min..max]");
+    const char *const p = pattern.str();
+    m_signed = p[1] == 'i';
+    const unsigned bits = p[2] == '8' ? 8 : 10u * (p[2] - '0') + (p[3] - '0');
+    const Tag tags[2][4] = {
+        {constants::tagUInt8, constants::tagUInt16, constants::tagUInt32,
+         constants::tagUInt64},
+        {constants::tagInt8, constants::tagInt16, constants::tagInt,
+         constants::tagInt64}};
+    m_tag = tags[m_signed][bits == 8 ? 0 : bits == 16 ? 1 : bits == 32 ? 2 : 3];
+    const uint64_t top = uint64_t(1) << (bits - 1);
+    m_min = m_signed ? negate(top) : 0;
+    m_max = m_signed ? top - 1 : top - 1 + top;
+
+    const std::size_t open = bits == 8 ? 3 : 4;
+    if (open == pattern.len()) {
+      return;
+    }
+    std::size_t dots = open + 1;
+    while (dots + 1 < pattern.len() - 1 &&
+           !(p[dots] == '.' && p[dots + 1] == '.')) {
+      dots++;
+    }
+    uint64_t min = 0;
+    uint64_t max = 0;
+    const bool ok =
+        dots + 1 < pattern.len() - 1 &&
+        parse(p + open + 1, dots - open - 1, min) &&
+        parse(p + dots + 2, pattern.len() - 1 - dots - 2, max);
+    CLI_ASSERT(ok, "range must be [min..max] within the width");
+    CLI_ASSERT(!ok || (m_signed ? static_cast<int64_t>(min) <=
+                                      static_cast<int64_t>(max)
+                                : min <= max),
+               "range must not be empty");
+    m_min = min;
+    m_max = max;
+  }
+
+  constexpr Tag tag() const { return m_tag; }
+
+  template <typename Argument>
+  bool parse(const Token &input, Argument &arg) const {
+    if (input.escaped()) {
+      char scratch[parsers::detail::numberScratch];
+      const std::size_t len = input.unescape(scratch, sizeof(scratch));
+      return len < sizeof(scratch) && parse(Token(scratch, len), arg);
+    }
+    uint64_t value = 0;
+    if (!parse(input.str(), input.len(), value)) {
+      return false;
+    }
+    switch (m_tag) {
+    case constants::tagInt8:
+      arg = Argument::create(m_tag, static_cast<int8_t>(value));
+      break;
+    case constants::tagUInt8:
+      arg = Argument::create(m_tag, static_cast<uint8_t>(value));
+      break;
+    case constants::tagInt16:
+      arg = Argument::create(m_tag, static_cast<int16_t>(value));
+      break;
+    case constants::tagUInt16:
+      arg = Argument::create(m_tag, static_cast<uint16_t>(value));
+      break;
+    case constants::tagInt:
+      arg = Argument::create(m_tag, static_cast<int32_t>(value));
+      break;
+    case constants::tagUInt32:
+      arg = Argument::create(m_tag, static_cast<uint32_t>(value));
+      break;
+    case constants::tagInt64:
+      arg = Argument::create(m_tag, static_cast<int64_t>(value));
+      break;
+    default:
+      arg = Argument::create(m_tag, value);
+      break;
+    }
+    return true;
+  }
+};
+
+/* @class PlaceholderFormat
+ * Parser of a placeholder which describes its own arguments, a choice like
+ * "?{on|off}" or a sized integer like "?u8[0..7]". Commands build one for
+ * every such placeholder of their pattern, so these take no schema.
+ */
+class PlaceholderFormat {
+  enum class Kind : uint8_t { choices, integer };
+
+  Kind m_kind = Kind::choices;
+  union {
+    Choices m_choices = {};
+    IntegerFormat m_integer;
+  };
+
+public:
+  static constexpr bool isFormat(const Token &placeholder) {
+    return Choices::isChoice(placeholder) ||
+           IntegerFormat::isInteger(placeholder);
+  }
+
+  PlaceholderFormat() = default;
+  constexpr explicit PlaceholderFormat(const Token &placeholder) {
+    if (IntegerFormat::isInteger(placeholder)) {
+      m_integer = IntegerFormat(placeholder);
+      m_kind = Kind::integer;
+    } else {
+      m_choices = Choices(placeholder);
+    }
+  }
+
+  // Choices parse to their index as an int
+  constexpr Tag tag() const {
+    return m_kind == Kind::integer ? m_integer.tag() : constants::tagInt;
+  }
+
+  // @param placeholder is the token the format was built from
+  template <typename Argument>
+  bool parse(const Token &placeholder, const Token &inputToken,
+             Argument &arg) const {
+    if (m_kind == Kind::integer) {
+      return m_integer.parse(inputToken, arg);
+    }
+    const int index = m_choices.find(placeholder, inputToken);
+    if (index < 0) {
+      return false;
+    }
+    arg = Argument::create(constants::tagInt, index);
+    return true;
+  }
+};
+
+template <typename Config> class BasicSchema {
+public:
+  using Argument = typename Types<Config>::Argument;
+  using TokenParser = typename Types<Config>::TokenParser;
+
+private:
+  Token m_pattern;
+  TokenParser m_parser = nullptr;
+  Tag m_tag = constants::tagInvalid;
+
+public:
+  BasicSchema() = default;
+  /* @param tag is the tag of the arguments produced by parser. It is used to
+   * check typed callbacks at registration, tagInvalid accepts any type.
+   */
+  CLI_CONSTEXPR BasicSchema(const char *pattern, TokenParser parser,
+                            Tag tag = constants::tagInvalid)
+      : m_pattern(pattern, std::char_traits<char>::length(pattern)),
+        m_parser(parser), m_tag(tag) {}
+
+  CLI_CONSTEXPR bool isSchema(const Token &commandToken) const {
+    return m_pattern == commandToken;
+  }
+
+  CLI_CONSTEXPR Tag getTag() const { return m_tag; }
+
+  bool parse(const Token &inputToken, Argument &arg) const {
+    if (m_parser == nullptr) {
+      return false;
+    }
+    return m_parser(inputToken, arg);
+  }
+};
+
+/* @class BasicArgument is a tagged union wrapping multiple
+ * types of parsed data.
+ */
+template <typename Config> class BasicArgument {
+  static constexpr bool isView = Config::argTextView;
+  static constexpr std::size_t textLen = Config::argMaxTextLen;
+  static_assert(isView || textLen > 0,
+                "argMaxTextLen must leave room for the null");
+
+public:
+  Tag m_tag = constants::tagInvalid;
+  bool m_escaped = false; // string views of escaped tokens
+  bool m_view = false;    // string views in copy mode, see rest
+  uint32_t m_len = 0;     // length of string arguments
+
+  union Data {
+    const char *view;                // argTextView
+    char text[isView ? 1 : textLen]; // copy otherwise
+    int integer;
+    float decimal;
+    uint64_t raw64 = 0;
+  };
+  Data m_value = {};
+
+public:
+  BasicArgument() = default;
+
+  bool isValid() const { return m_tag != constants::tagInvalid; }
+
+  Tag getTag() const { return m_tag; }
+
+  template <typename T> static BasicArgument create(Tag tag, T value) {
+    static_assert(sizeof(T) <= sizeof(uint64_t) &&
+                      std::is_trivially_copyable<T>::value,
+                  "argument values must be trivially copyable and fit in 8 "
+                  "bytes");
+    BasicArgument a;
+    a.m_tag = tag;
+    std::memcpy(&a.m_value.raw64, &value, sizeof(T));
+    return a;
+  }
+
+  template <typename T> T get() const {
+    static_assert(sizeof(T) <= sizeof(uint64_t) &&
+                      std::is_trivially_copyable<T>::value,
+                  "argument values must be trivially copyable and fit in 8 "
+                  "bytes");
+    T value;
+    std::memcpy(&value, &m_value.raw64, sizeof(T));
+    return value;
+  }
+
+  template <typename T> T get(Tag tag) const {
+    if (m_tag != tag) {
+      CLI_WARN("get on non matching tag");
+      if constexpr (Config::stats) {
+        Stats<Config>::tagMismatch();
+      }
+      return T();
+    }
+    return get<T>();
+  }
+
+  /* With argTextView the argument points into the input, and is valid until
+   * the callback returns. Views of escaped tokens stay escaped, see
+   * Token::unescape. Otherwise the token is copied and unescaped, truncated
+   * to argMaxTextLen - 1 characters.
+   */
+  static BasicArgument text(const Token &token) {
+    BasicArgument a;
+    a.m_tag = constants::tagString;
+    if constexpr (isView) {
+      a.m_escaped = token.escaped();
+      a.m_len = static_cast<uint32_t>(token.len());
+      a.m_value.view = token.str();
+    } else {
+      a.m_len = static_cast<uint32_t>(token.unescape(a.m_value.text,
+                                                     textLen - 1));
+      a.m_value.text[a.m_len] = 0;
+    }
+    return a;
+  }
+
+  /* The rest of a line, from the first to the last token, as a view into
+   * the input even in copy mode. It is valid until the callback returns. A
+   * single token is passed like text does it with argTextView, several are
+   * passed as typed, with their quotes and backslashes.
+   */
+  static BasicArgument rest(const Token &first, const Token &last) {
+    BasicArgument a;
+    a.m_tag = constants::tagString;
+    a.m_view = true;
+    if (first.str() == last.str()) {
+      a.m_escaped = first.escaped();
+      a.m_len = static_cast<uint32_t>(first.len());
+      a.m_value.view = first.str();
+      return a;
+    }
+    const char *const begin = first.str() - (first.quoted() ? 1 : 0);
+    const char *const end = last.str() + last.len() + (last.quoted() ? 1 : 0);
+    a.m_len = static_cast<uint32_t>(end - begin);
+    a.m_value.view = begin;
+    return a;
+  }
+
+  Token getToken() const {
+    if (m_tag != constants::tagString) {
+      CLI_WARN("trying to get non-word argument as word\n");
+      return Token();
+    }
+
+    if (isView || m_view) {
+      return Token(m_value.view, m_len, m_escaped);
+    } else {
+      return Token(m_value.text, m_len);
+    }
+  }
+
+  const char *getString() const {
+    static_assert(!isView, "views aren't null terminated, use getToken");
+    if (m_tag != constants::tagString) {
+      CLI_WARN("trying to get non-word argument as word\n");
+      return "";
+    }
+    if (m_view) {
+      CLI_WARN("the rest of a line isn't null terminated, use getToken\n");
+      return "";
+    }
+
+    return m_value.text;
+  }
+
+  // int getInt() const {
+  //   if (m_tag != Tag::integer) {
+  //     CLI_WARN("trying to get non-int argument as integer\n");
+  //     return 0;
+  //   }
+
+  //   return m_value.integer;
+  // }
+  // float getFloat() const {
+  //   if (m_tag != Tag::decimal) {
+  //     CLI_WARN("trying to get non-float argument as float\n");
+  //     return 0.0;
+  //   }
+
+  //   return m_value.decimal;
+  // }
+};
+
+// The default schemas of any config
+// The parsers are plain function pointers, so the schemas are constexpr
+namespace schemas {
+template <typename Config> CLI_CONSTEXPR BasicSchema<Config> text() {
+  using Argument = BasicArgument<Config>;
+  return BasicSchema<Config>(
+      "?s",
+      +[](const Token &input, Argument &result) {
+        result = Argument::text(input);
+        return true;
+      },
+      constants::tagString);
+}
+
+template <typename Config> CLI_CONSTEXPR BasicSchema<Config> integer() {
+  using Argument = BasicArgument<Config>;
+  return BasicSchema<Config>(
+      "?i",
+      +[](const Token &input, Argument &result) {
+        int value;
+        if (!parsers::parseInteger(input, value)) {
+          return false;
+        }
+        result = Argument::create(constants::tagInt, value);
+        return true;
+      },
+      constants::tagInt);
+}
+
+template <typename Config> CLI_CONSTEXPR BasicSchema<Config> decimal() {
+  using Argument = BasicArgument<Config>;
+  return BasicSchema<Config>(
+      "?f",
+      +[](const Token &input, Argument &result) {
+        float value;
+        if (!parsers::parseFloat(input, value)) {
+          return false;
+        }
+        result = Argument::create(constants::tagFloat, value);
+        return true;
+      },
+      constants::tagFloat);
+}
+} // namespace schemas
+
+static CLI_CONSTEXPR const Schema schemaText = schemas::text<DefaultConfig>();
+static CLI_CONSTEXPR const Schema schemaInteger =
+    schemas::integer<DefaultConfig>();
+static CLI_CONSTEXPR const Schema schemaFloat =
+    schemas::decimal<DefaultConfig>();
+
+/* Typed callbacks, ie. [](int min, int max) for the pattern "lim ?i ?i".
+ * Each parameter receives the argument of the matching placeholder, in order.
+ */
+namespace typed {
+/* Param<T> reads parameters of type T. missing is set for types which accept
+ * the invalid argument of an optional token which wasn't given, and view for
+ * types which accept the rest of a line.
+ */
+template <typename T, typename = void> struct Param;
+
+// Tag of the arguments of integer placeholders of type T
+template <typename T> constexpr Tag integerTag() {
+  constexpr bool isSigned = std::is_signed<T>::value;
+  switch (sizeof(T)) {
+  case 1:
+    return isSigned ? constants::tagInt8 : constants::tagUInt8;
+  case 2:
+    return isSigned ? constants::tagInt16 : constants::tagUInt16;
+  case 4:
+    return isSigned ? constants::tagInt : constants::tagUInt32;
+  default:
+    return isSigned ? constants::tagInt64 : constants::tagUInt64;
+  }
+}
+// int for ?i, other widths for the placeholders of IntegerFormat
+template <typename T>
+struct Param<T, std::enable_if_t<std::is_integral<T>::value &&
+                                 !std::is_same<T, bool>::value>> {
+  static constexpr Tag tag = integerTag<T>();
+  static constexpr bool missing = false;
+  static constexpr bool view = false;
+  template <typename Argument> static T get(const Argument &arg) {
+    return arg.template get<T>(tag);
+  }
+};
+template <> struct Param<float> {
+  static constexpr Tag tag = constants::tagFloat;
+  static constexpr bool missing = false;
+  static constexpr bool view = false;
+  template <typename Argument> static float get(const Argument &arg) {
+    return arg.template get<float>(tag);
+  }
+};
+// not available with argTextView
+template <> struct Param<const char *> {
+  static constexpr Tag tag = constants::tagString;
+  static constexpr bool missing = false;
+  static constexpr bool view = false;
+  template <typename Argument> static const char *get(const Argument &arg) {
+    return arg.getString();
+  }
+};
+template <> struct Param<Token> {
+  static constexpr Tag tag = constants::tagString;
+  static constexpr bool missing = false;
+  static constexpr bool view = true;
+  template <typename Argument> static Token get(const Argument &arg) {
+    return arg.getToken();
+  }
+};
+// the index of the word of a choice placeholder, ie. enum class Led { on, off }
+template <typename T>
+struct Param<T, std::enable_if_t<std::is_enum<T>::value>> {
+  static constexpr Tag tag = constants::tagInt;
+  static constexpr bool missing = false;
+  static constexpr bool view = false;
+  template <typename Argument> static T get(const Argument &arg) {
+    return static_cast<T>(arg.template get<int>(tag));
+  }
+};
+template <typename Config> struct Param<BasicArgument<Config>> {
+  static constexpr Tag tag = constants::tagInvalid; // any
+  static constexpr bool missing = true;
+  static constexpr bool view = true;
+  static const BasicArgument<Config> &get(const BasicArgument<Config> &arg) {
+    return arg;
+  }
+};
+// optional tokens, empty if the token wasn't given
+template <typename T> struct Param<std::optional<T>> {
+  static constexpr Tag tag = Param<T>::tag;
+  static constexpr bool missing = true;
+  static constexpr bool view = Param<T>::view;
+  template <typename Argument>
+  static std::optional<T> get(const Argument &arg) {
+    if (!arg.isValid()) {
+      return std::nullopt;
+    }
+    return Param<T>::get(arg);
+  }
+};
+
+// a trailing OutputSink & parameter receives the output of the run
+template <> struct Param<OutputSink> {
+  static constexpr Tag tag = constants::tagInvalid;
+  static constexpr bool missing = false;
+  static constexpr bool view = false;
+};
+
+template <typename F> struct Signature : Signature<decltype(&F::operator())> {};
+template <typename R, typename... A> struct Signature<R (*)(A...)> {
+  template <template <typename...> class T> using Apply = T<std::decay_t<A>...>;
+};
+template <typename R, typename... A>
+struct Signature<R(A...)> : Signature<R (*)(A...)> {};
+template <typename C, typename R, typename... A>
+struct Signature<R (C::*)(A...)> : Signature<R (*)(A...)> {};
+template <typename C, typename R, typename... A>
+struct Signature<R (C::*)(A...) const> : Signature<R (*)(A...)> {};
+
+constexpr bool isCompatible(Tag param, Tag schema) {
+  return param == constants::tagInvalid || schema == constants::tagInvalid ||
+         param == schema;
+}
+
+template <typename... A> constexpr bool takesOutput() {
+  if constexpr (sizeof...(A) == 0) {
+    return false;
+  } else {
+    using Last = std::tuple_element_t<sizeof...(A) - 1, std::tuple<A...>>;
+    return std::is_same<Last, OutputSink>::value;
+  }
+}
+
+template <typename... A> struct Adapter {
+  static constexpr bool output = takesOutput<A...>();
+  // number of placeholders
+  static constexpr std::size_t arity = sizeof...(A) - (output ? 1 : 0);
+  static constexpr Tag tags[sizeof...(A) + 1] = {Param<A>::tag...,
+                                                 constants::tagInvalid};
+  static constexpr bool missing[sizeof...(A) + 1] = {Param<A>::missing...,
+                                                     false};
+  static constexpr bool views[sizeof...(A) + 1] = {Param<A>::view..., false};
+  template <std::size_t I>
+  using ParamAt = Param<std::tuple_element_t<I, std::tuple<A...>>>;
+
+  template <typename F> class Invoker {
+    mutable F m_f;
+    std::array<uint8_t, arity> m_index;
+
+    template <typename Arguments, std::size_t... I>
+    void call(const Arguments &args, OutputSink &out,
+              std::index_sequence<I...>) const {
+      if constexpr (output) {
+        m_f(ParamAt<I>::get(args[m_index[I]])..., out);
+      } else {
+        m_f(ParamAt<I>::get(args[m_index[I]])...);
+      }
+    }
+
+  public:
+    Invoker(F f, const std::array<uint8_t, arity> &index)
+        : m_f(std::move(f)), m_index(index) {}
+
+    template <typename Arguments>
+    void operator()(const Arguments &args, OutputSink &out) const {
+      call(args, out, std::make_index_sequence<arity>());
+    }
+  };
+};
+
+template <typename F>
+using AdapterFor = typename Signature<std::decay_t<F>>::template Apply<Adapter>;
+
+template <typename F, typename Arguments = cli::Arguments>
+constexpr bool isTyped =
+    !std::is_invocable<F, const Arguments &>::value &&
+    !std::is_invocable<F, const Arguments &, OutputSink &>::value;
+} // namespace typed
+
+namespace str {
+bool isInt(char c) { return '0' <= c && c <= '9'; }
+int toInt(char c) { return static_cast<int>(c - '0'); }
+
+/* Character classes for the tokenizer. Whitespace is the same set as
+ * std::isspace in the "C" locale, independent of the current locale.
+ */
+constexpr uint8_t classSpace = 1;
+constexpr uint8_t classEnd = 2; // null character
+struct CharClasses {
+  uint8_t table[256] = {};
+
+  constexpr CharClasses() {
+    table[0] = classEnd;
+    const char spaces[] = {' ', '\t', '\n', '\v', '\f', '\r'};
+    for (const char c : spaces) {
+      table[static_cast<uint8_t>(c)] = classSpace;
+    }
+  }
+};
+constexpr CharClasses charClasses;
+
+inline uint8_t charClass(char c) {
+  return charClasses.table[static_cast<uint8_t>(c)];
+}
+
+bool isSpace(char c) { return charClass(c) == classSpace; }
+
+#if defined(CLI_TOKENIZER_SSE2)
+constexpr std::size_t blockSize = 16;
+
+// bit i is set if byte i is whitespace or null
+inline uint32_t delimiterMask(const char *p) {
+  const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+  const __m128i fromTab = _mm_sub_epi8(v, _mm_set1_epi8('\t'));
+  const __m128i controls =
+      _mm_cmpeq_epi8(_mm_min_epu8(fromTab, _mm_set1_epi8(4)), fromTab);
+  const __m128i spaces = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+  const __m128i nulls = _mm_cmpeq_epi8(v, _mm_setzero_si128());
+  return static_cast<uint32_t>(
+      _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(controls, spaces), nulls)));
+}
+inline uint32_t spaceMask(const char *p) {
+  const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+  const __m128i fromTab = _mm_sub_epi8(v, _mm_set1_epi8('\t'));
+  const __m128i controls =
+      _mm_cmpeq_epi8(_mm_min_epu8(fromTab, _mm_set1_epi8(4)), fromTab);
+  const __m128i spaces = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+  return static_cast<uint32_t>(_mm_movemask_epi8(_mm_or_si128(controls, spaces)));
+}
+inline std::size_t firstSet(uint32_t mask) {
+  return static_cast<std::size_t>(__builtin_ctz(mask));
+}
+constexpr uint32_t allSet = 0xFFFF;
+#elif defined(CLI_TOKENIZER_SWAR)
+constexpr std::size_t blockSize = 8;
+constexpr uint64_t ones = 0x0101010101010101ull;
+constexpr uint64_t highBits = 0x8080808080808080ull;
+
+inline uint64_t load64(const char *p) {
+  uint64_t word;
+  std::memcpy(&word, p, sizeof(word));
+  return word;
+}
+// high bit of every byte equal to c, exact for all bytes
+inline uint64_t equalMask(uint64_t word, uint8_t c) {
+  const uint64_t x = word ^ (ones * c);
+  return ~(((x & ~highBits) + ~highBits) | x) & highBits;
+}
+// high bit of every byte in ['\t', '\r'], exact for all bytes
+inline uint64_t controlMask(uint64_t word) {
+  const uint64_t low = word & ~highBits;
+  const uint64_t atLeastTab = low + ones * (0x80 - '\t');
+  const uint64_t aboveCr = low + ones * (0x80 - '\r' - 1);
+  return atLeastTab & ~aboveCr & ~word & highBits;
+}
+inline uint64_t spaceMask(const char *p) {
+  const uint64_t word = load64(p);
+  return controlMask(word) | equalMask(word, ' ');
+}
+inline uint64_t delimiterMask(const char *p) {
+  const uint64_t word = load64(p);
+  return controlMask(word) | equalMask(word, ' ') | equalMask(word, 0);
+}
+inline std::size_t firstSet(uint64_t mask) {
+  return static_cast<std::size_t>(__builtin_ctzll(mask)) / 8;
+}
+constexpr uint64_t allSet = highBits;
+#endif
+
+// First whitespace or null character in [begin, end), or end
+const char *findDelimiter(const char *begin, const char *end) {
+  const char *p = begin;
+#if defined(CLI_TOKENIZER_SSE2) || defined(CLI_TOKENIZER_SWAR)
+  for (; end - p >= static_cast<std::ptrdiff_t>(blockSize); p += blockSize) {
+    const auto mask = delimiterMask(p);
+    if (mask != 0) {
+      return p + firstSet(mask);
+    }
+  }
+#endif
+  while (p < end && charClass(*p) == 0) {
+    p++;
+  }
+  return p;
+}
+
+// First character in [begin, end) which isn't whitespace, or end
+const char *skipSpace(const char *begin, const char *end) {
+  const char *p = begin;
+#if defined(CLI_TOKENIZER_SSE2) || defined(CLI_TOKENIZER_SWAR)
+  for (; end - p >= static_cast<std::ptrdiff_t>(blockSize); p += blockSize) {
+    const auto mask = spaceMask(p) ^ allSet;
+    if (mask != 0) {
+      return p + firstSet(mask);
+    }
+  }
+#endif
+  while (p < end && charClass(*p) == classSpace) {
+    p++;
+  }
+  return p;
+}
+
+bool isQuote(char c) { return c == '"' || c == '\''; }
+
+/* Closing quote in [begin, end), or the null character or end if the quote
+ * isn't closed. A backslash skips the next character.
+ * @param escaped is set if the quoted text contains a backslash
+ */
+const char *findQuote(const char *begin, const char *end, char quote,
+                      bool &escaped) {
+  escaped = false;
+  const char *p = begin;
+  while (p < end && *p != quote && *p != 0) {
+    if (*p == '\\' && p + 1 < end && p[1] != 0) {
+      escaped = true;
+      p++;
+    }
+    p++;
+  }
+  return p;
+}
+} // namespace str
+
+namespace str {
+/* Decimal digits accumulated into a 64 bit integer. At most 19 significant
+ * digits are kept, the rest are counted so the caller can scale the value.
+ */
+struct Digits {
+  static constexpr std::size_t maxSignificant = 19;
+
+  uint64_t value = 0;
+  std::size_t significant = 0;
+  std::size_t dropped = 0;
+  bool droppedNonZero = false;
+};
+
+#if defined(CLI_DIGITS_SWAR)
+inline bool isEightDigits(uint64_t word) {
+  return ((word & 0xF0F0F0F0F0F0F0F0ull) |
+          (((word + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) >> 4)) ==
+         0x3333333333333333ull;
+}
+
+inline uint32_t eightDigits(uint64_t word) {
+  word -= 0x3030303030303030ull;
+  word = (word * 10) + (word >> 8);
+  word = (((word & 0x000000FF000000FFull) * (100 + (1000000ull << 32))) +
+          (((word >> 16) & 0x000000FF000000FFull) * (1 + (10000ull << 32)))) >>
+         32;
+  return static_cast<uint32_t>(word);
+}
+#endif
+
+// Consumes the digits in [p, end), returns the first character which isn't a
+// digit or end
+inline const char *readDigits(const char *p, const char *end, Digits &digits) {
+  if (digits.value == 0) {
+    while (p < end && *p == '0') {
+      p++;
+    }
+  }
+#if defined(CLI_DIGITS_SWAR)
+  // after the leading zeros every digit is significant
+  while (end - p >= 8 && digits.significant + 8 <= Digits::maxSignificant) {
+    uint64_t word;
+    std::memcpy(&word, p, sizeof(word));
+    if (!isEightDigits(word)) {
+      break;
+    }
+    digits.value = digits.value * 100000000u + eightDigits(word);
+    digits.significant += 8;
+    p += 8;
+  }
+#endif
+  for (; p < end && isInt(*p); p++) {
+    const int digit = toInt(*p);
+    if (digits.value == 0 && digit == 0) {
+      continue;
+    }
+    if (digits.significant < Digits::maxSignificant) {
+      digits.value = digits.value * 10 + static_cast<uint64_t>(digit);
+      digits.significant++;
+    } else {
+      digits.dropped++;
+      digits.droppedNonZero |= digit != 0;
+    }
+  }
+  return p;
+}
+} // namespace str
+
+namespace parsers {
+namespace detail {
+/* Token of the quoted span starting at p, without the quotes. Moves p past
+ * the span, which ends after the closing quote if there is one.
+ */
+Token splitQuoted(const char *&p, const char *end) {
+  const char quote = *p;
+  bool escaped;
+  const char *const close = str::findQuote(p + 1, end, quote, escaped);
+  const bool closed = close < end && *close == quote;
+  const Token token(p + 1, static_cast<std::size_t>(close - p - 1), escaped,
+                    closed);
+  p = closed ? close + 1 : close;
+  return token;
+}
+
+/* Token starting at p, which isn't whitespace, and moves p past it.
+ * @return false if a quote isn't closed or is followed by more than
+ * whitespace, ie. "ab or "ab"cd
+ */
+bool splitToken(const char *&p, const char *end, Token &token) {
+  if (!str::isQuote(*p)) {
+    const char *const begin = p;
+    p = str::findDelimiter(p, end);
+    token = Token(begin, static_cast<std::size_t>(p - begin));
+    return true;
+  }
+  token = splitQuoted(p, end);
+  return token.quoted() && (p == end || *p == 0 || str::isSpace(*p));
+}
+} // namespace detail
+
+bool parseInteger(const Token &token, int &value) {
+  ParseError error;
+  return parseInteger(token, value, error);
+}
+
+bool parseInteger(const Token &token, int &value, ParseError &error) {
+  error = ParseError::invalid;
+  if (!token.isValid()) {
+    return false;
+  }
+  if (token.escaped()) {
+    char scratch[detail::numberScratch];
+    const std::size_t len = token.unescape(scratch, sizeof(scratch));
+    return len < sizeof(scratch) &&
+           parseInteger(Token(scratch, len), value, error);
+  }
+
+  const char *p = token.str();
+  const char *const end = p + token.len();
+  const bool isNegative = *p == '-';
+  if (*p == '-' || *p == '+') {
+    p++;
+  }
+
+  const char *const digitsBegin = p;
+  str::Digits digits;
+  p = str::readDigits(p, end, digits);
+  if (p == digitsBegin || p != end) {
+    return false;
+  }
+
+  const uint64_t limit =
+      static_cast<uint64_t>(std::numeric_limits<int>::max()) +
+      (isNegative ? 1 : 0);
+  if (digits.dropped > 0 || digits.value > limit) {
+    error = ParseError::outOfRange;
+    return false;
+  }
+
+  value = isNegative ? static_cast<int>(0 - digits.value)
+                     : static_cast<int>(digits.value);
+  error = ParseError::none;
+  return true;
+}
+
+namespace detail {
+// Rounding the exact value to double and then to float is only wrong when the
+// double lands exactly halfway between two floats
+inline bool isFloatMidpoint(double d) {
+  const float f = static_cast<float>(d);
+  if (static_cast<double>(f) == d) {
+    return false;
+  }
+  const float other = std::nextafter(
+      f, d > f ? std::numeric_limits<float>::infinity()
+               : -std::numeric_limits<float>::infinity());
+  return (static_cast<double>(f) + static_cast<double>(other)) / 2 == d;
+}
+
+/* value = mantissa * 10^exponent for mantissas below 2^53 and exponents in
+ * [-22, 22], where both factors and thus the rounded result are exact
+ * (Clinger's fast path).
+ * @return false if the fast path doesn't apply
+ */
+inline bool fastFloat(uint64_t mantissa, int exponent, float &value) {
+  constexpr float floatPowers[] = {1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f,
+                                   1e6f, 1e7f, 1e8f, 1e9f, 1e10f};
+  constexpr double doublePowers[] = {
+      1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+      1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+  if (mantissa <= (uint64_t(1) << 24) && -10 <= exponent && exponent <= 10) {
+    const float m = static_cast<float>(mantissa);
+    value = exponent < 0 ? m / floatPowers[-exponent]
+                         : m * floatPowers[exponent];
+    return true;
+  }
+
+  if (mantissa <= (uint64_t(1) << 53) && -22 <= exponent && exponent <= 22) {
+    const double m = static_cast<double>(mantissa);
+    const double d = exponent < 0 ? m / doublePowers[-exponent]
+                                  : m * doublePowers[exponent];
+    if (isFloatMidpoint(d)) {
+      return false;
+    }
+    value = static_cast<float>(d);
+    return true;
+  }
+
+  return false;
+}
+
+// Correctly rounded conversion of a validated number for the rare inputs
+// outside the fast path
+inline ParseError slowFloat(const char *begin, const char *end, float &value) {
+  if (*begin == '+') {
+    begin++;
+  }
+#if defined(__cpp_lib_to_chars)
+  const std::from_chars_result result = std::from_chars(begin, end, value);
+  if (result.ec == std::errc::result_out_of_range) {
+    return ParseError::outOfRange;
+  }
+  return result.ec == std::errc() && result.ptr == end ? ParseError::none
+                                                       : ParseError::invalid;
+#else
+  // strtof needs a null terminated copy, and assumes the "C" locale
+  char buffer[128];
+  const std::size_t len = static_cast<std::size_t>(end - begin);
+  if (len >= sizeof(buffer)) {
+    return ParseError::invalid;
+  }
+  std::memcpy(buffer, begin, len);
+  buffer[len] = 0;
+  value = std::strtof(buffer, nullptr);
+  return ParseError::none;
+#endif
+}
+} // namespace detail
+
+bool parseFloat(const Token &token, float &value) {
+  ParseError error;
+  return parseFloat(token, value, error);
+}
+
+/* Parses [+-](digits[.digits] | .digits)[(e|E)[+-]digits]. Results which
+ * overflow to infinity or underflow to zero are range errors.
+ */
+bool parseFloat(const Token &token, float &value, ParseError &error) {
+  error = ParseError::invalid;
+  if (!token.isValid()) {
+    return false;
+  }
+  if (token.escaped()) {
+    char scratch[detail::numberScratch];
+    const std::size_t len = token.unescape(scratch, sizeof(scratch));
+    return len < sizeof(scratch) &&
+           parseFloat(Token(scratch, len), value, error);
+  }
+
+  const char *p = token.str();
+  const char *const end = p + token.len();
+  const bool isNegative = *p == '-';
+  if (*p == '-' || *p == '+') {
+    p++;
+  }
+
+  str::Digits digits;
+  const char *const integerBegin = p;
+  p = str::readDigits(p, end, digits);
+  std::size_t mantissaDigits = static_cast<std::size_t>(p - integerBegin);
+
+  long exponent = 0;
+  if (p < end && *p == '.') {
+    p++;
+    const char *const fractionBegin = p;
+    p = str::readDigits(p, end, digits);
+    const std::size_t fractionDigits = static_cast<std::size_t>(p - fractionBegin);
+    mantissaDigits += fractionDigits;
+    exponent -= static_cast<long>(fractionDigits);
+  }
+  if (mantissaDigits == 0) {
+    return false;
+  }
+
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    p++;
+    const bool negativeExponent = p < end && *p == '-';
+    if (p < end && (*p == '-' || *p == '+')) {
+      p++;
+    }
+    const char *const exponentBegin = p;
+    long explicitExponent = 0;
+    for (; p < end && str::isInt(*p); p++) {
+      // saturate, anything this large is out of range anyway
+      if (explicitExponent < 100000) {
+        explicitExponent = explicitExponent * 10 + str::toInt(*p);
+      }
+    }
+    if (p == exponentBegin) {
+      return false;
+    }
+    exponent += negativeExponent ? -explicitExponent : explicitExponent;
+  }
+  if (p != end) {
+    return false;
+  }
+
+  if (digits.value == 0) {
+    value = isNegative ? -0.0f : 0.0f;
+    error = ParseError::none;
+    return true;
+  }
+
+  exponent += static_cast<long>(digits.dropped);
+  // the value is in [10^(exponent + significant - 1), 10^(exponent +
+  // significant)), float covers about [1.4e-45, 3.4e38]
+  const long magnitude = exponent + static_cast<long>(digits.significant);
+  if (magnitude > 39 || magnitude < -45) {
+    error = ParseError::outOfRange;
+    return false;
+  }
+
+  float result = 0.0f;
+  if (digits.droppedNonZero ||
+      !detail::fastFloat(digits.value, static_cast<int>(exponent), result)) {
+    // the slow path parses the sign itself
+    error = detail::slowFloat(token.str(), end, result);
+    if (error != ParseError::none) {
+      return false;
+    }
+  } else if (isNegative) {
+    result = -result;
+  }
+
+  if (result == 0.0f || result == std::numeric_limits<float>::infinity() ||
+      result == -std::numeric_limits<float>::infinity()) {
+    error = ParseError::outOfRange;
+    return false;
+  }
+
+  value = result;
+  error = ParseError::none;
+  return true;
+}
+
+/* Offsets are SizeT of the default config, tokens ending beyond its range
+ * are not found. Use the std::size_t overload for long inputs.
+ */
+bool tokenSplitter(const char *input, SizeT &tokenStart, SizeT &tokenLen) {
+  std::size_t start = tokenStart;
+  std::size_t len = 0;
+  if (!tokenSplitter(input, tokenStart + std::strlen(input + tokenStart),
+                     start, len) ||
+      start + len > std::numeric_limits<SizeT>::max()) {
+    return false;
+  }
+  tokenStart = start;
+  tokenLen = len;
+  return true;
+}
+
+/* Finds the next token at or after tokenStart. The input ends after inputLen
+ * characters or at a null character, whichever comes first. A token starting
+ * with " or ' runs to the matching quote, whitespace included, and the span
+ * includes the quotes; unquote turns it into the token. Quotes which aren't
+ * closed or are followed by more than whitespace end the search like the end
+ * of the input, use tokenize to tell them apart.
+ */
+bool tokenSplitter(const char *input, std::size_t inputLen,
+                   std::size_t &tokenStart, std::size_t &tokenLen) {
+  if (tokenStart >= inputLen) {
+    return false;
+  }
+
+  const char *const end = input + inputLen;
+  const char *const begin = str::skipSpace(input + tokenStart, end);
+  if (begin == end || *begin == 0) {
+    return false;
+  }
+
+  const char *spanEnd = begin;
+  Token token;
+  if (!detail::splitToken(spanEnd, end, token)) {
+    return false;
+  }
+  tokenStart = static_cast<std::size_t>(begin - input);
+  tokenLen = static_cast<std::size_t>(spanEnd - begin);
+  return true;
+}
+
+/* Token of a span found by tokenSplitter. Quotes are removed, and quoted text
+ * with backslashes becomes an escaped token which isn't copied until a
+ * schema needs its value. Other spans are returned as they are.
+ */
+Token unquote(const Token &span) {
+  if (span.len() == 0 || !str::isQuote(span.str()[0])) {
+    return span;
+  }
+  const char *p = span.str();
+  return detail::splitQuoted(p, span.str() + span.len());
+}
+
+Argument argumentParser(const Schemas &schemas, const Token &commandToken,
+                        const Token &inputToken) {
+  CLI_ASSERT(commandToken.isValid(), "commandToken is invalid");
+  CLI_ASSERT(inputToken.isValid(), "inputToken is invalid");
+
+  for (SizeT i = 0; i < schemas.size(); i++) {
+    if (!schemas[i].isSchema(commandToken)) {
+      continue;
+    }
+
+    Argument arg;
+    if (!schemas[i].parse(inputToken, arg)) {
+      continue;
+    }
+    return arg;
+  }
+
+  if (inputToken == commandToken) {
+    return Argument::text(inputToken);
+  }
+
+  return Argument();
+}
+
+Tokens tokenParser(const char *str) {
+  return tokenParser(str, std::strlen(str));
+}
+
+Tokens tokenParser(const char *str, std::size_t len) {
+  return tokenize<Tokens>(str, len);
+}
+
+/* Splits str into the tokens container of any config. Input with a quote
+ * which isn't closed or is followed by more than whitespace has no tokens.
+ */
+template <typename Tokens> Tokens tokenize(const char *str, std::size_t len) {
+  bool truncated;
+  return tokenize<Tokens>(str, len, truncated);
+}
+
+// @param truncated is set if str has more tokens than fit into Tokens
+template <typename Tokens>
+Tokens tokenize(const char *str, std::size_t len, bool &truncated) {
+  bool malformed;
+  return tokenize<Tokens>(str, len, truncated, malformed);
+}
+
+// @param malformed is set if the quotes of str make it no tokens at all
+template <typename Tokens>
+Tokens tokenize(const char *str, std::size_t len, bool &truncated,
+                bool &malformed) {
+  Tokens tokens;
+  truncated = false;
+  malformed = false;
+  // tokenSplitter and unquote in one pass
+  const char *p = str;
+  const char *const end = str + len;
+  while (true) {
+    p = str::skipSpace(p, end);
+    if (p == end || *p == 0) {
+      break;
+    }
+    Token token;
+    if (!detail::splitToken(p, end, token)) {
+      truncated = false;
+      malformed = true;
+      return Tokens();
+    }
+    // tokens past the limit are still checked for malformed quotes
+    if (!truncated && !tokens.push_back(token)) {
+      truncated = true;
+    }
+  }
+
+  return tokens;
+}
+} // namespace parsers
+
+#if defined(__cpp_nontype_template_args) &&                                    \
+    __cpp_nontype_template_args >= 201911L
+#define CLI_HAS_STATIC_PATTERNS 1
+
+/* Command patterns given as template arguments, ie.
+ * cli.withCommand<"pm lim vin ?i ?i">(callback). The pattern is tokenized and
+ * checked against the default schemas by the compiler, and matching compares
+ * literals with fixed length memcmp and calls the parsers directly.
+ */
+namespace patterns {
+template <std::size_t N> struct FixedString {
+  char text[N] = {};
+
+  constexpr FixedString(const char (&str)[N]) {
+    for (std::size_t i = 0; i < N; i++) {
+      text[i] = str[i];
+    }
+  }
+
+  static constexpr std::size_t size() { return N - 1; }
+};
+
+enum class Kind : uint8_t {
+  literal,
+  integer,
+  decimal,
+  text,
+  choice,
+  // integers of a fixed width, see IntegerFormat
+  sized,
+  unknown
+};
+
+struct Part {
+  std::size_t start = 0;
+  std::size_t len = 0;
+  Kind kind = Kind::literal;
+};
+
+// N is enough for every token of a pattern of N characters
+template <std::size_t N> struct Parts {
+  std::array<Part, N> parts = {};
+  std::size_t count = 0;
+  std::size_t literalPrefix = 0;
+  std::array<uint8_t, N> placeholders = {};
+  std::size_t placeholderCount = 0;
+  bool unknownPlaceholder = false;
+  bool optionalOrRest = false;
+};
+
+constexpr bool isSpace(char c) {
+  return str::charClasses.table[static_cast<uint8_t>(c)] == str::classSpace;
+}
+
+constexpr Tag tagOf(Kind kind) {
+  switch (kind) {
+  case Kind::integer:
+  case Kind::choice:
+    return constants::tagInt;
+  case Kind::decimal:
+    return constants::tagFloat;
+  case Kind::text:
+    return constants::tagString;
+  default:
+    return constants::tagInvalid;
+  }
+}
+
+constexpr Kind kindOf(const char *token, std::size_t len) {
+  if (token[0] != '?') {
+    return Kind::literal;
+  }
+  if (len == 2 && token[1] == 'i') {
+    return Kind::integer;
+  }
+  if (len == 2 && token[1] == 'f') {
+    return Kind::decimal;
+  }
+  if (len == 2 && token[1] == 's') {
+    return Kind::text;
+  }
+  if (Choices::isChoice(Token(token, len))) {
+    return Kind::choice;
+  }
+  if (IntegerFormat::isInteger(Token(token, len))) {
+    return Kind::sized;
+  }
+  return Kind::unknown;
+}
+
+template <std::size_t N>
+constexpr Parts<N / 2 + 1> split(const FixedString<N> &pattern) {
+  Parts<N / 2 + 1> result;
+  bool inPrefix = true;
+  std::size_t i = 0;
+  while (i < pattern.size()) {
+    if (isSpace(pattern.text[i])) {
+      i++;
+      continue;
+    }
+
+    Part part;
+    part.start = i;
+    while (i < pattern.size() && !isSpace(pattern.text[i])) {
+      i++;
+    }
+    part.len = i - part.start;
+    part.kind = kindOf(pattern.text + part.start, part.len);
+
+    const char *const text = pattern.text + part.start;
+    result.optionalOrRest |=
+        text[0] == '[' ||
+        (part.len > 3 && text[part.len - 1] == '.' &&
+         text[part.len - 2] == '.' && text[part.len - 3] == '.');
+    result.unknownPlaceholder |= part.kind == Kind::unknown;
+    inPrefix &= part.kind == Kind::literal;
+    result.literalPrefix += inPrefix ? 1 : 0;
+    if (part.kind != Kind::literal) {
+      result.placeholders[result.placeholderCount++] =
+          static_cast<uint8_t>(result.count);
+    }
+    result.parts[result.count++] = part;
+  }
+  return result;
+}
+
+template <FixedString P> class Static {
+  static constexpr auto s_parts = split(P);
+  static_assert(!s_parts.optionalOrRest,
+                "optional and rest tokens need the runtime withCommand");
+  static_assert(!s_parts.unknownPlaceholder,
+                "pattern uses a placeholder without a default schema, "
+                "use the runtime withCommand for custom schemas");
+
+  template <std::size_t I, typename Arguments>
+  static bool matchPart(const Token &input, Arguments &args) {
+    using Argument = typename Arguments::value_type;
+    constexpr Part part = s_parts.parts[I];
+    if constexpr (part.kind == Kind::literal) {
+      if (input.len() != part.len ||
+          std::memcmp(input.str(), P.text + part.start, part.len) != 0) {
+        return false;
+      }
+      return args.push_back(Argument::text(input));
+    } else if constexpr (part.kind == Kind::integer) {
+      int value;
+      return parsers::parseInteger(input, value) &&
+             args.push_back(Argument::create(constants::tagInt, value));
+    } else if constexpr (part.kind == Kind::decimal) {
+      float value;
+      return parsers::parseFloat(input, value) &&
+             args.push_back(Argument::create(constants::tagFloat, value));
+    } else if constexpr (part.kind == Kind::choice) {
+      static constexpr Token pattern(P.text + part.start, part.len);
+      static constexpr Choices choices(pattern);
+      const int index = choices.find(pattern, input);
+      return index >= 0 &&
+             args.push_back(Argument::create(constants::tagInt, index));
+    } else if constexpr (part.kind == Kind::sized) {
+      static constexpr IntegerFormat format(
+          Token(P.text + part.start, part.len));
+      Argument arg;
+      return format.parse(input, arg) && args.push_back(arg);
+    } else {
+      return args.push_back(Argument::text(input));
+    }
+  }
+
+  template <typename Tokens, typename Arguments, std::size_t... I>
+  static bool matchParts(const Tokens &input, Arguments &args,
+                         std::index_sequence<I...>) {
+    return (matchPart<I>(input[I], args) && ...);
+  }
+
+public:
+  static constexpr std::size_t tokenCount = s_parts.count;
+  static constexpr std::size_t literalPrefix = s_parts.literalPrefix;
+  static constexpr std::size_t placeholderCount = s_parts.placeholderCount;
+
+  static constexpr uint8_t placeholderIndex(std::size_t i) {
+    return s_parts.placeholders[i];
+  }
+  static constexpr Tag placeholderTag(std::size_t i) {
+    const Part &part = s_parts.parts[placeholderIndex(i)];
+    if (part.kind == Kind::sized) {
+      return IntegerFormat(Token(P.text + part.start, part.len)).tag();
+    }
+    return tagOf(part.kind);
+  }
+
+  template <typename Tokens, typename Arguments>
+  static bool match(const Tokens &input, Arguments &args) {
+    args.clear();
+    if (input.size() != s_parts.count) {
+      return false;
+    }
+    return matchParts(input, args, std::make_index_sequence<s_parts.count>());
+  }
+
+  template <typename Tokens> static constexpr Tokens tokens() {
+    Tokens tokens;
+    for (std::size_t i = 0; i < s_parts.count; i++) {
+      const Part &part = s_parts.parts[i];
+      tokens.push_back(Token(P.text + part.start, part.len));
+    }
+    return tokens;
+  }
+};
+} // namespace patterns
+#endif
+
+template <typename Config> class BasicCommand {
+public:
+  using SizeT = typename Config::SizeT;
+  using Argument = typename Types<Config>::Argument;
+  using Arguments = typename Types<Config>::Arguments;
+  using Callback = typename Types<Config>::Callback;
+  using Matcher = typename Types<Config>::Matcher;
+  using Schemas = typename Types<Config>::Schemas;
+  using Tokens = typename Types<Config>::Tokens;
+
+  // Binding of pattern tokens which aren't placeholders
+  static constexpr SizeT literal = std::numeric_limits<SizeT>::max();
+  // Bindings from formatBinding on are formats of the command, not schemas
+  static constexpr SizeT formatBinding =
+      static_cast<SizeT>(Config::schemasCountMax);
+  static_assert(Config::schemasCountMax + Config::cmdFormatsMax < literal,
+                "SizeT of the config is too small for the bindings");
+
+private:
+  Callback m_callback = nullptr;
+  // pattern tokens without the brackets and dots of optional and rest tokens
+  Tokens m_patternTokens;
+  // Schema or format index of every pattern token, resolved at registration
+  std::array<SizeT, Config::cmdTokensMax> m_bindings;
+  // choice and sized integer placeholders, shared by equal tokens
+  FixedVector<PlaceholderFormat, Config::cmdFormatsMax, SizeT> m_formats;
+  Matcher m_matcher = nullptr;
+  SizeT m_literalPrefix = 0;
+  // tokens before the first optional or rest token
+  SizeT m_required = 0;
+  // input tokens needed to match, a rest token needs one unless optional
+  SizeT m_minTokens = 0;
+  bool m_rest = false;
+  bool m_bindingsFixed = false;
+
+  static constexpr bool isOptionalToken(const Token &token) {
+    return token.len() > 2 && token.str()[0] == '[' &&
+           token.str()[token.len() - 1] == ']';
+  }
+  static CLI_CONSTEXPR bool isRestToken(const Token &token) {
+    return token.len() > 3 &&
+           std::char_traits<char>::compare(token.str() + token.len() - 3,
+                                           "...", 3) == 0;
+  }
+
+  /* Splits a pattern at whitespace in constant expressions, where the
+   * tokenizer isn't available. Patterns don't use quotes.
+   */
+  static CLI_CONSTEXPR Tokens splitPattern(const char *pattern) {
+    Tokens tokens;
+    const char *p = pattern;
+    while (*p != 0) {
+      if (str::charClasses.table[static_cast<uint8_t>(*p)] ==
+          str::classSpace) {
+        p++;
+        continue;
+      }
+      const char *const start = p;
+      while (*p != 0 && str::charClasses.table[static_cast<uint8_t>(*p)] !=
+                            str::classSpace) {
+        p++;
+      }
+      if (!tokens.push_back(
+              Token(start, static_cast<std::size_t>(p - start)))) {
+        break;
+      }
+    }
+    return tokens;
+  }
+
+  CLI_CONSTEXPR bool isFormat(SizeT i) const {
+    return m_bindings[i] != literal && m_bindings[i] >= formatBinding;
+  }
+  CLI_CONSTEXPR const PlaceholderFormat &format(SizeT i) const {
+    return m_formats[static_cast<SizeT>(m_bindings[i] - formatBinding)];
+  }
+
+  // Builds the formats of the choice and sized integer placeholders
+  CLI_CONSTEXPR void addFormats() {
+    for (SizeT i = 0; i < m_patternTokens.size(); i++) {
+      const Token &token = m_patternTokens[i];
+      if (isRest(i) || !PlaceholderFormat::isFormat(token)) {
+        continue;
+      }
+      SizeT binding = literal;
+      for (SizeT j = 0; j < i && binding == literal; j++) {
+        if (isFormat(j) && m_patternTokens[j] == token) {
+          binding = m_bindings[j];
+        }
+      }
+      if (binding == literal) {
+        CLI_ASSERT(m_formats.size() < Config::cmdFormatsMax,
+                   "no room for the format of a placeholder, raise "
+                   "cmdFormatsMax");
+        if (!m_formats.push_back(PlaceholderFormat(token))) {
+          continue;
+        }
+        binding = static_cast<SizeT>(formatBinding + m_formats.size() - 1);
+      }
+      m_bindings[i] = binding;
+    }
+  }
+
+  /* Strips "[token]" of optional and "token..." of rest tokens. Optional
+   * tokens must follow the required ones and only the last token may be a
+   * rest token.
+   */
+  CLI_CONSTEXPR void shape() {
+    const SizeT size = m_patternTokens.size();
+    m_required = size;
+    m_minTokens = size;
+    m_rest = false;
+    for (SizeT i = 0; i < size; i++) {
+      Token &token = m_patternTokens[i];
+      const bool optional = isOptionalToken(token);
+      if (optional) {
+        token = Token(token.str() + 1, token.len() - 2);
+      }
+      const bool rest = isRestToken(token);
+      if (rest) {
+        CLI_ASSERT(i + 1 == size, "only the last token can take the rest");
+        token = Token(token.str(), token.len() - 3);
+        m_rest = true;
+      }
+      if ((optional || rest) && m_required == size) {
+        m_required = i;
+        m_minTokens = i;
+      }
+      CLI_ASSERT(optional || rest || m_required == size,
+                 "required tokens must come before optional ones");
+      if (rest && !optional) {
+        m_minTokens++;
+      }
+    }
+  }
+
+public:
+  CLI_CONSTEXPR BasicCommand() { m_bindings.fill(literal); }
+  CLI_CONSTEXPR BasicCommand(const char *pattern, Callback callback)
+      : m_callback(std::move(callback)),
+        m_patternTokens(detail::constantEvaluated()
+                            ? splitPattern(pattern)
+                            : parsers::tokenize<Tokens>(
+                                  pattern, std::strlen(pattern))) {
+    m_bindings.fill(literal);
+    shape();
+    addFormats();
+  }
+
+  /* Command from already tokenized patterns. A matcher from a pattern
+   * resolved at compile time replaces the schema lookup in parse, without
+   * one the pattern is bound to schemas like a runtime pattern.
+   */
+  CLI_CONSTEXPR BasicCommand(const Tokens &patternTokens, SizeT literalPrefix,
+                             Matcher matcher, Callback callback)
+      : m_callback(std::move(callback)), m_patternTokens(patternTokens),
+        m_matcher(matcher), m_literalPrefix(literalPrefix) {
+    m_bindings.fill(literal);
+    shape();
+    if (m_matcher == nullptr) {
+      addFormats();
+    }
+  }
+
+  CLI_CONSTEXPR const Tokens &patternTokens() const { return m_patternTokens; }
+
+  /* Resolves every pattern token to the index of its schema in schemas, so
+   * parse doesn't have to look schemas up. Called again when schemas are
+   * registered after the command. Choice and sized integer placeholders keep
+   * their format.
+   * @return false if the bindings were fixed and would change
+   */
+  CLI_CONSTEXPR bool bind(const Schemas &schemas) {
+    if (m_matcher != nullptr) {
+      return true;
+    }
+    for (SizeT i = 0; i < m_patternTokens.size(); i++) {
+      if (isFormat(i)) {
+        continue;
+      }
+      SizeT binding = literal;
+      for (SizeT s = 0; s < schemas.size(); s++) {
+        if (schemas[s].isSchema(m_patternTokens[i])) {
+          binding = s;
+          break;
+        }
+      }
+      if (m_bindingsFixed && binding != m_bindings[i]) {
+        return false;
+      }
+      m_bindings[i] = binding;
+    }
+
+    m_literalPrefix = 0;
+    while (m_literalPrefix < m_required &&
+           m_bindings[m_literalPrefix] == literal) {
+      m_literalPrefix++;
+    }
+    return true;
+  }
+
+  // Bindings which other state (ie. typed callbacks) depend on
+  CLI_CONSTEXPR void fixBindings() { m_bindingsFixed = true; }
+
+  // Tag of the arguments of bound placeholder i
+  CLI_CONSTEXPR Tag tag(const Schemas &schemas, SizeT i) const {
+    return isFormat(i) ? format(i).tag() : schemas[m_bindings[i]].getTag();
+  }
+
+  // Parses inputToken as bound placeholder i
+  bool parseToken(const Schemas &schemas, SizeT i, const Token &inputToken,
+                  Argument &arg) const {
+    if (isFormat(i)) {
+      return format(i).parse(m_patternTokens[i], inputToken, arg);
+    }
+    return schemas[m_bindings[i]].parse(inputToken, arg);
+  }
+
+  /* Whether pattern token i takes an argument. Compile-time patterns aren't
+   * bound, their placeholders are the '?' tokens after the literal prefix.
+   */
+  CLI_CONSTEXPR bool isPlaceholder(SizeT i) const {
+    if (isRest(i)) {
+      return true;
+    }
+    if (m_matcher != nullptr) {
+      return i >= m_literalPrefix && m_patternTokens[i].str()[0] == '?';
+    }
+    return m_bindings[i] != literal;
+  }
+
+  CLI_CONSTEXPR bool isOptional(SizeT i) const {
+    return i >= m_required && !(isRest(i) && m_minTokens > m_required);
+  }
+  CLI_CONSTEXPR bool isRest(SizeT i) const {
+    return m_rest && i + 1 == m_patternTokens.size();
+  }
+  CLI_CONSTEXPR bool hasRest() const { return m_rest; }
+
+  /* Pattern token which input token i stands for when every optional token
+   * is given, literal past the end of the pattern.
+   */
+  SizeT patternIndex(SizeT i) const {
+    if (i < m_patternTokens.size() - (m_rest ? 1 : 0)) {
+      return i;
+    }
+    return m_rest ? m_patternTokens.size() - 1 : literal;
+  }
+
+  /* Whether inputToken may stand at input position i, like parse checks it
+   * when every optional token is given. Unbound placeholders of compile-time
+   * patterns accept any token.
+   */
+  bool accepts(const Schemas &schemas, SizeT inputIndex,
+               const Token &inputToken) const {
+    const SizeT i = patternIndex(inputIndex);
+    if (i == literal) {
+      return false;
+    }
+    if (isRest(i) || inputToken == m_patternTokens[i]) {
+      return true;
+    }
+    if (!isPlaceholder(i)) {
+      return false;
+    }
+    if (m_bindings[i] == literal) {
+      return true;
+    }
+    Argument arg;
+    return parseToken(schemas, i, inputToken, arg);
+  }
+
+  // Number of leading pattern tokens which must match the input literally
+  CLI_CONSTEXPR SizeT literalPrefix() const { return m_literalPrefix; }
+
+  /* Every pattern token gets an argument, missing optional tokens an invalid
+   * one. Optional tokens take the input tokens left after the required ones
+   * and one for a rest token, in order. An optional token which doesn't match
+   * the next input token is skipped, so the token goes to the following ones,
+   * ie. "set 1 2.5" gives "set ?i [?i] [?f]" no second integer.
+   * @param reason is set to schemaParse when a placeholder didn't parse, and
+   * left alone on other mismatches. Compile-time patterns report every
+   * mismatch of a line with the right number of tokens as schemaParse.
+   * @param tail is set if the last input token is the tail of a line with
+   * too many tokens, which only a rest token can take
+   */
+  bool parse(const Schemas &schemas, const Tokens &inputTokens,
+             Arguments &args, Rejection *reason = nullptr,
+             bool tail = false) const {
+    if (tail && !m_rest) {
+      return false;
+    }
+    if (m_matcher != nullptr) {
+      const bool matched = m_matcher(inputTokens, args);
+      if (!matched && reason != nullptr &&
+          inputTokens.size() == m_patternTokens.size()) {
+        *reason = Rejection::schemaParse;
+      }
+      return matched;
+    }
+
+    args.clear();
+
+    const SizeT count = inputTokens.size();
+    const SizeT size = m_patternTokens.size();
+    if (count < m_minTokens || (!m_rest && count > size)) {
+      return false;
+    }
+
+    const SizeT fixed = size - (m_rest ? 1 : 0);
+    // input tokens before the one a required rest token needs
+    const SizeT available = count - (m_minTokens - m_required);
+    SizeT given = 0;
+    bool skipped = false;
+    for (SizeT i = 0; i < fixed; i++) {
+      if (given >= available) {
+        args.push_back(Argument());
+        continue;
+      }
+      const Token &inputToken = inputTokens[given];
+      Argument arg;
+      if (m_bindings[i] != literal &&
+          parseToken(schemas, i, inputToken, arg)) {
+        args.push_back(arg);
+        given++;
+        continue;
+      }
+
+      // placeholders also match themselves, like argumentParser
+      if (inputToken == m_patternTokens[i]) {
+        args.push_back(Argument::text(inputToken));
+        given++;
+        continue;
+      }
+      if (reason != nullptr && m_bindings[i] != literal) {
+        skipped = true;
+      }
+      if (i < m_required) {
+        if (skipped) {
+          *reason = Rejection::schemaParse;
+        }
+        return false;
+      }
+      args.push_back(Argument());
+    }
+
+    if (!m_rest && given < count) {
+      if (skipped) {
+        *reason = Rejection::schemaParse;
+      }
+      return false;
+    }
+    if (m_rest) {
+      if (given < count) {
+        args.push_back(
+            Argument::rest(inputTokens[given], inputTokens[count - 1]));
+      } else if (tail) {
+        return false;
+      } else {
+        args.push_back(Argument());
+      }
+    }
+    return true;
+  }
+
+  CLI_CONSTEXPR void setCallback(const Callback &callback) {
+    m_callback = callback;
+  }
+
+  void run(const Arguments &args, OutputSink &out) const {
+    m_callback(args, out);
+  }
+  void run(const Arguments &args) const {
+    OutputSink discard;
+    m_callback(args, discard);
+  }
+
+  void getHelp(HelpWriter writer) const { writeHelp(writer); }
+
+  // getHelp for any writer, ie. the constexpr help of BasicCLI
+  template <typename Writer>
+  CLI_CONSTEXPR void writeHelp(Writer &&writer) const {
+    for (SizeT i = 0; i < m_patternTokens.size(); i++) {
+      const auto &t = m_patternTokens[i];
+      if (isOptional(i)) {
+        writer("[", 1);
+      }
+      writer(t.str(), t.len());
+      if (isRest(i)) {
+        writer("...", 3);
+      }
+      if (isOptional(i)) {
+        writer("]", 1);
+      }
+      writer(" ", 1);
+    }
+  }
+};
+
+/* @class CommandIndex
+ * Prefix trie over the leading literal tokens of the registered commands.
+ * Every command is attached to the node of its longest literal prefix, so
+ * dispatch walks the input once and only parses the commands attached to
+ * the visited nodes. Children are found through an open addressing table
+ * keyed on (parent, token).
+ */
+template <typename Config> class BasicCommandIndex {
+public:
+  using SizeT = typename Config::SizeT;
+  using Command = typename Types<Config>::Command;
+  using Tokens = typename Types<Config>::Tokens;
+
+  static constexpr SizeT npos = std::numeric_limits<SizeT>::max();
+
+private:
+  static constexpr uint32_t slotCount = 2 * Config::trieNodesMax;
+  static_assert(slotCount < npos && Config::cmdCountMax < npos,
+                "SizeT of the config is too small for the trie capacity");
+
+  struct Node {
+    Token literal;
+    SizeT parent = npos;
+    SizeT firstChild = npos;
+    SizeT nextSibling = npos;
+    SizeT firstCommand = npos;
+    SizeT lastCommand = npos;
+  };
+
+  FixedVector<Node, Config::trieNodesMax, SizeT> m_nodes;
+  std::array<SizeT, slotCount> m_slots;
+  std::array<SizeT, Config::cmdCountMax> m_nextCommand = {};
+
+  static CLI_CONSTEXPR uint32_t hash(SizeT parent, const Token &token) {
+    uint32_t h = 2166136261u ^ (static_cast<uint32_t>(parent) * 0x9E3779B1u);
+    for (std::size_t i = 0; i < token.len(); i++) {
+      h = (h ^ static_cast<uint8_t>(token.str()[i])) * 16777619u;
+    }
+    return h;
+  }
+
+  CLI_CONSTEXPR SizeT findSlot(SizeT parent, const Token &token) const {
+    uint32_t slot = hash(parent, token) % slotCount;
+    while (m_slots[slot] != npos) {
+      const Node &node = m_nodes[m_slots[slot]];
+      if (node.parent == parent && node.literal == token) {
+        break;
+      }
+      slot = (slot + 1) % slotCount;
+    }
+    return static_cast<SizeT>(slot);
+  }
+
+public:
+  CLI_CONSTEXPR BasicCommandIndex() { clear(); }
+
+  CLI_CONSTEXPR void clear() {
+    m_nodes.clear();
+    m_slots.fill(npos);
+    m_nodes.push_back(Node()); // root
+  }
+
+  static constexpr SizeT root = 0;
+
+  CLI_CONSTEXPR SizeT child(SizeT parent, const Token &token) const {
+    return m_slots[findSlot(parent, token)];
+  }
+
+  // Children of a node in reverse insertion order, npos after the last
+  SizeT firstChild(SizeT node) const { return m_nodes[node].firstChild; }
+  SizeT nextSibling(SizeT node) const { return m_nodes[node].nextSibling; }
+  const Token &literal(SizeT node) const { return m_nodes[node].literal; }
+
+  // Commands attached to a node in registration order, npos after the last
+  SizeT firstCommand(SizeT node) const { return m_nodes[node].firstCommand; }
+  SizeT nextCommand(SizeT command) const { return m_nextCommand[command]; }
+
+  CLI_CONSTEXPR void insert(const Command &command, SizeT index) {
+    const Tokens &pattern = command.patternTokens();
+    const SizeT literalPrefix = command.literalPrefix();
+    SizeT node = 0;
+    for (SizeT i = 0; i < literalPrefix; i++) {
+      const SizeT slot = findSlot(node, pattern[i]);
+      if (m_slots[slot] == npos) {
+        Node next;
+        next.literal = pattern[i];
+        next.parent = node;
+        next.nextSibling = m_nodes[node].firstChild;
+        if (!m_nodes.push_back(next)) {
+          break;
+        }
+        m_slots[slot] = m_nodes.size() - 1;
+        m_nodes[node].firstChild = m_slots[slot];
+      }
+      node = m_slots[slot];
+    }
+
+    Node &owner = m_nodes[node];
+    m_nextCommand[index] = npos;
+    if (owner.lastCommand == npos) {
+      owner.firstCommand = index;
+    } else {
+      m_nextCommand[owner.lastCommand] = index;
+    }
+    owner.lastCommand = index;
+  }
+
+  /* Calls tryCommand with the index of every command whose literal prefix
+   * matches the input, in registration order, until it returns true.
+   */
+  template <typename F>
+  bool forEachCandidate(const Tokens &input, F &&tryCommand) const {
+    std::array<SizeT, Config::cmdTokensMax + 1> cursors;
+    SizeT depth = 0;
+    SizeT node = 0;
+    cursors[depth++] = m_nodes[node].firstCommand;
+    for (SizeT i = 0; i < input.size(); i++) {
+      node = child(node, input[i]);
+      if (node == npos) {
+        break;
+      }
+      cursors[depth++] = m_nodes[node].firstCommand;
+    }
+
+    // candidate lists are sorted, so merging them keeps registration order
+    while (true) {
+      SizeT best = npos;
+      SizeT bestDepth = 0;
+      for (SizeT d = 0; d < depth; d++) {
+        if (cursors[d] < best) {
+          best = cursors[d];
+          bestDepth = d;
+        }
+      }
+      if (best == npos) {
+        return false;
+      }
+      if (tryCommand(best)) {
+        return true;
+      }
+      cursors[bestDepth] = m_nextCommand[best];
+    }
+  }
+};
+
+/* @class BasicCLI
+ * Commands, schemas and dispatch index of one CLI, with the capacities of
+ * Config. CLI uses DefaultConfig.
+ *
+ * Once built, the const members never modify the CLI, so any number of
+ * threads may call run, match and getHelp concurrently, as long as the
+ * callbacks and schema parsers they reach are safe to call concurrently.
+ * Registering commands or schemas while other threads run input isn't.
+ *
+ * With C++20 the builder works in constant expressions as long as callbacks
+ * and schema parsers are plain function pointers and the config has neither
+ * stats nor a command cache, so the tables can be constexpr, ie.
+ *   void led(const cli::Arguments &args, cli::OutputSink &out);
+ *   constexpr auto cli = [] {
+ *     cli::CLI cli;
+ *     cli.withDefaultSchemas().withCommand("led ?i", led);
+ *     return cli;
+ *   }();
+ * Building a local rather than chaining on a temporary also works around
+ * GCC 12, which fails to destroy the temporary in a constant expression.
+ */
+template <typename Config> class BasicCLI {
+public:
+  using SizeT = typename Config::SizeT;
+  using Argument = typename Types<Config>::Argument;
+  using Arguments = typename Types<Config>::Arguments;
+  using Callback = typename Types<Config>::Callback;
+  using Command = typename Types<Config>::Command;
+  using Commands = typename Types<Config>::Commands;
+  using Schema = typename Types<Config>::Schema;
+  using Schemas = typename Types<Config>::Schemas;
+  using Tokens = typename Types<Config>::Tokens;
+  using TokenParser = typename Types<Config>::TokenParser;
+
+private:
+  static_assert(!Config::argTextView ||
+                    sizeof(Argument) <= 2 * sizeof(uint64_t),
+                "Argument should be a tag and 8 bytes in view mode");
+
+  Commands m_commands;
+  Schemas m_schemas;
+  BasicCommandIndex<Config> m_index;
+  using CLIStats =
+      std::conditional_t<Config::stats, Stats<Config>, NoStats<Config>>;
+  [[no_unique_address]] CLIStats m_stats;
+  using Cache =
+      std::conditional_t<(Config::commandCacheSize > 0), CommandCache<Config>,
+                         NoCommandCache<Config>>;
+  [[no_unique_address]] Cache m_cache;
+  // help of every command, built by withCommand while it fits
+  std::array<char, Config::helpTextMax> m_helpText = {};
+  std::size_t m_helpLen = 0;
+  bool m_helpComplete = true;
+  // help and stats commands, their callbacks are bound to this CLI
+  static constexpr SizeT noCommand = std::numeric_limits<SizeT>::max();
+  SizeT m_helpCommand = noCommand;
+  SizeT m_statsCommand = noCommand;
+
+  struct Group {
+    Token prefix;
+    const BasicCLI *cli = nullptr;
+  };
+  FixedVector<Group, Config::groupCountMax, SizeT> m_groups;
+
+  friend class BasicCompleter<Config>;
+
+  static void runHelp(const void *cli, const Arguments &, OutputSink &out) {
+    static_cast<const BasicCLI *>(cli)->getHelp(out);
+  }
+  static void runStats(const void *cli, const Arguments &, OutputSink &out) {
+    static_cast<const BasicCLI *>(cli)->getStats(out);
+  }
+
+  // Points the callbacks of the help and stats commands at this CLI
+  CLI_CONSTEXPR void bindBuiltins() {
+    if (m_helpCommand != noCommand) {
+      m_commands[m_helpCommand].setCallback(Callback(&runHelp, this));
+    }
+    if constexpr (Config::stats) {
+      if (m_statsCommand != noCommand) {
+        m_commands[m_statsCommand].setCallback(Callback(&runStats, this));
+      }
+    }
+  }
+
+  CLI_CONSTEXPR void appendHelp(const char *text, std::size_t len) {
+    if (!m_helpComplete || len == 0) {
+      return;
+    }
+    if (len > Config::helpTextMax - m_helpLen) {
+      m_helpComplete = false;
+      return;
+    }
+    std::char_traits<char>::copy(m_helpText.data() + m_helpLen, text, len);
+    m_helpLen += len;
+  }
+
+  CLI_CONSTEXPR void appendHelp(const Command &command) {
+    command.writeHelp([this](const char *text, std::size_t len) {
+      appendHelp(text, len);
+    });
+    appendHelp("\n", 1);
+  }
+
+  CLI_CONSTEXPR void reindex() {
+    m_index.clear();
+    m_cache.clear();
+    for (SizeT i = 0; i < m_commands.size(); i++) {
+      m_index.insert(m_commands[i], i);
+      if constexpr (Config::commandCacheSize > 0) {
+        m_cache.setCacheable(i, !shadowed(i));
+      }
+    }
+  }
+
+  /* Whether an earlier command may match lines which start with the literal
+   * prefix of the command, when their prefixes agree up to the shorter one.
+   */
+  CLI_CONSTEXPR bool shadowed(SizeT command) const {
+    const Tokens &tokens = m_commands[command].patternTokens();
+    const SizeT len = m_commands[command].literalPrefix();
+    if (len == 0) {
+      return true;
+    }
+    for (SizeT j = 0; j < command; j++) {
+      const Tokens &other = m_commands[j].patternTokens();
+      const SizeT otherLen = m_commands[j].literalPrefix();
+      const SizeT common = len < otherLen ? len : otherLen;
+      SizeT t = 0;
+      while (t < common && tokens[t] == other[t]) {
+        t++;
+      }
+      if (t == common) {
+        return true;
+      }
+    }
     return false;
   }
 
-  const bool isNegative = first == '-';
-  const bool skipFirst = first == '-' || first == '+';
-  SizeT i = 0;
-  if (skipFirst) {
-    i = 1;
+  // The group whose prefix is the first token, if there is one
+  CLI_CONSTEXPR const BasicCLI *group(const Token &first) const {
+    for (SizeT i = 0; i < m_groups.size(); i++) {
+      if (m_groups[i].prefix == first) {
+        return m_groups[i].cli;
+      }
+    }
+    return nullptr;
+  }
+  static CLI_CONSTEXPR bool startsWith(const Command &command,
+                                       const Token &prefix) {
+    const Tokens &tokens = command.patternTokens();
+    return tokens.size() > 0 && tokens[0] == prefix;
+  }
+  const BasicCLI *group(const Tokens &inputTokens) const {
+    return inputTokens.size() > 0 ? group(inputTokens[0]) : nullptr;
+  }
+
+  // The tokens after the prefix of a group
+  static Tokens inGroup(const Tokens &inputTokens) {
+    Tokens rest;
+    for (SizeT i = 1; i < inputTokens.size(); i++) {
+      rest.push_back(inputTokens[i]);
+    }
+    return rest;
+  }
+
+  /* Lines with more tokens than the config allows end in a tail token with
+   * the rest of the line, which only rest tokens can take.
+   * @param tail is set for such lines
+   * @return false if the quotes of the line are malformed
+   */
+  bool tokenize(const char *input, std::size_t len, Tokens &tokens,
+                bool &tail) const {
+    const uint64_t start = m_stats.now();
+    bool malformed;
+    tokens = parsers::tokenize<Tokens>(input, len, tail, malformed);
+    if (tail && tokens.size() > 0) {
+      const Token &last = tokens[tokens.size() - 1];
+      const char *const begin = last.str() - (last.quoted() ? 1 : 0);
+      const char *end = input + len;
+      const void *null =
+          std::memchr(begin, 0, static_cast<std::size_t>(end - begin));
+      if (null != nullptr) {
+        end = static_cast<const char *>(null);
+      }
+      while (end > begin && str::isSpace(end[-1])) {
+        end--;
+      }
+      tokens[tokens.size() - 1] =
+          Token(begin, static_cast<std::size_t>(end - begin));
+    }
+    m_stats.record(Phase::tokenize, start);
+    return !malformed;
+  }
+
+  // match of run, dispatching to groups
+  const Command *match(const Tokens &inputTokens, bool tail,
+                       Arguments &arguments) const {
+    if (const BasicCLI *sub = group(inputTokens)) {
+      return sub->match(inGroup(inputTokens), tail, arguments);
+    }
+    return match(inputTokens, arguments, nullptr, tail);
+  }
+
+  const Command *match(const Tokens &inputTokens, Arguments &arguments,
+                       Rejection *reason, bool tail) const {
+    if constexpr (Config::commandCacheSize > 0) {
+      std::size_t slot = 0;
+      const SizeT cached = m_cache.find(inputTokens, slot);
+      if (cached != Cache::none && cached < m_commands.size() &&
+          m_commands[cached].parse(m_schemas, inputTokens, arguments, nullptr,
+                                   tail)) {
+        m_cache.hit(slot);
+        return &m_commands[cached];
+      }
+      m_cache.miss();
+    }
+
+    const Command *matched = nullptr;
+    m_index.forEachCandidate(inputTokens, [&](SizeT i) {
+      if (!m_commands[i].parse(m_schemas, inputTokens, arguments, reason,
+                               tail)) {
+        return false;
+      }
+      matched = &m_commands[i];
+      if constexpr (Config::commandCacheSize > 0) {
+        m_cache.insert(inputTokens, i, matched->literalPrefix());
+      }
+      return true;
+    });
+    return matched;
   }
-  value = 0;
-  for (; i < token.len(); i++) {
-    const char c = *(token.str() + i);
-    if (!str::isInt(c)) {
+
+  // @param tail is set if the last token is the tail of the line, see tokenize
+  bool run(const Tokens &inputTokens, bool tail, OutputSink &out) const {
+    if (const BasicCLI *sub = group(inputTokens)) {
+      return sub->run(inGroup(inputTokens), tail, out);
+    }
+
+    Arguments arguments;
+    Rejection reason = tail ? Rejection::tokenLimit : Rejection::noMatch;
+    uint64_t start = m_stats.now();
+    const Command *command = match(inputTokens, arguments,
+                                   Config::stats ? &reason : nullptr, tail);
+    m_stats.record(Phase::match, start);
+    if (command == nullptr) {
+      m_stats.reject(reason);
       return false;
     }
-    const int digit = str::toInt(c);
-    value = digit + 10 * value;
+
+    const std::size_t index =
+        static_cast<std::size_t>(command - &m_commands[0]);
+    m_stats.hit(index);
+    start = m_stats.now();
+    command->run(arguments, out);
+    m_stats.record(Phase::callback, start);
+    return true;
   }
 
-  if (isNegative) {
-    value = -value;
+public:
+  BasicCLI() = default;
+  CLI_CONSTEXPR BasicCLI(const BasicCLI &other)
+      : m_commands(other.m_commands), m_schemas(other.m_schemas),
+        m_index(other.m_index), m_stats(other.m_stats), m_cache(other.m_cache),
+        m_helpText(other.m_helpText), m_helpLen(other.m_helpLen),
+        m_helpComplete(other.m_helpComplete),
+        m_helpCommand(other.m_helpCommand),
+        m_statsCommand(other.m_statsCommand), m_groups(other.m_groups) {
+    bindBuiltins();
+  }
+  CLI_CONSTEXPR BasicCLI &operator=(const BasicCLI &other) {
+    m_commands = other.m_commands;
+    m_schemas = other.m_schemas;
+    m_index = other.m_index;
+    m_stats = other.m_stats;
+    m_cache = other.m_cache;
+    m_helpText = other.m_helpText;
+    m_helpLen = other.m_helpLen;
+    m_helpComplete = other.m_helpComplete;
+    m_helpCommand = other.m_helpCommand;
+    m_statsCommand = other.m_statsCommand;
+    m_groups = other.m_groups;
+    bindBuiltins();
+    return *this;
+  }
+  CLI_CONSTEXPR BasicCLI(BasicCLI &&other)
+      : m_commands(std::move(other.m_commands)),
+        m_schemas(std::move(other.m_schemas)), m_index(other.m_index),
+        m_stats(other.m_stats), m_cache(other.m_cache),
+        m_helpText(other.m_helpText), m_helpLen(other.m_helpLen),
+        m_helpComplete(other.m_helpComplete),
+        m_helpCommand(other.m_helpCommand),
+        m_statsCommand(other.m_statsCommand), m_groups(other.m_groups) {
+    bindBuiltins();
+  }
+  CLI_CONSTEXPR BasicCLI &operator=(BasicCLI &&other) {
+    m_commands = std::move(other.m_commands);
+    m_schemas = std::move(other.m_schemas);
+    m_index = other.m_index;
+    m_stats = other.m_stats;
+    m_cache = other.m_cache;
+    m_helpText = other.m_helpText;
+    m_helpLen = other.m_helpLen;
+    m_helpComplete = other.m_helpComplete;
+    m_helpCommand = other.m_helpCommand;
+    m_statsCommand = other.m_statsCommand;
+    m_groups = other.m_groups;
+    bindBuiltins();
+    return *this;
   }
 
-  return true;
-}
+  /* The builder registers in place. Lvalues return themselves, so
+   *   cli.withCommand(...).withCommand(...);
+   * never copies or moves the tables, and building N commands is linear.
+   * Temporaries return the CLI by value, so a chain like
+   *   const auto &cli = CLI().withCommand(...).withCommand(...);
+   * can't leave a reference to a destroyed temporary. Every call of such a
+   * chain moves the CLI once: callbacks are moved rather than copied, but
+   * the tables are stored inline, so their bytes still move with it. Build
+   * large tables on an lvalue.
+   */
+  CLI_CONSTEXPR BasicCLI &withDefaultSchemas() & {
+    return withSchema(schemas::integer<Config>())
+        .withSchema(schemas::decimal<Config>())
+        .withSchema(schemas::text<Config>());
+  }
+  CLI_CONSTEXPR BasicCLI withDefaultSchemas() && {
+    return std::move(withDefaultSchemas());
+  }
 
-bool parseFloat(const Token &token, float &value) {
-  if (!token.isValid()) {
-    return false;
+  CLI_CONSTEXPR BasicCLI &withSchema(const Schema &schema) & {
+    m_schemas.push_back(schema);
+    // literal tokens may have become placeholders
+    for (SizeT i = 0; i < m_commands.size(); i++) {
+      CLI_ASSERT(m_commands[i].bind(m_schemas),
+                 "schema changes the placeholders of a typed command, "
+                 "register schemas before typed commands");
+    }
+    reindex();
+    return *this;
   }
-  const char &first = *token.str();
-  const bool validFirst = first == '+' || first == '-' || str::isInt(first);
-  if (!validFirst) {
-    return false;
+  CLI_CONSTEXPR BasicCLI withSchema(const Schema &schema) && {
+    return std::move(withSchema(schema));
+  }
+  CLI_CONSTEXPR BasicCLI &withSchema(const char *pattern, TokenParser parser,
+                                     Tag tag = constants::tagInvalid) & {
+    return withSchema(Schema(pattern, parser, tag));
+  }
+  CLI_CONSTEXPR BasicCLI withSchema(const char *pattern, TokenParser parser,
+                                    Tag tag = constants::tagInvalid) && {
+    return std::move(withSchema(pattern, parser, tag));
   }
 
-  const bool isNegative = first == '-';
-  const bool skipFirst = first == '-' || first == '+';
-  SizeT i = 0;
-  if (skipFirst) {
-    i = 1;
+  CLI_CONSTEXPR BasicCLI &withCommand(const Command &command) & {
+    for (SizeT i = 0; i < m_groups.size(); i++) {
+      CLI_ASSERT(!startsWith(command, m_groups[i].prefix),
+                 "command starts with the prefix of a group, which would "
+                 "take its lines");
+    }
+    if (m_commands.push_back(command)) {
+      const SizeT index = m_commands.size() - 1;
+      m_commands[index].bind(m_schemas);
+      m_index.insert(m_commands[index], index);
+      if constexpr (Config::commandCacheSize > 0) {
+        m_cache.setCacheable(index, !shadowed(index));
+      }
+      appendHelp(m_commands[index]);
+    }
+    return *this;
+  }
+  CLI_CONSTEXPR BasicCLI withCommand(const Command &command) && {
+    return std::move(withCommand(command));
+  }
+  CLI_CONSTEXPR BasicCLI &withCommand(const char *pattern,
+                                      Callback callback) & {
+    return withCommand(Command(pattern, std::move(callback)));
+  }
+  CLI_CONSTEXPR BasicCLI withCommand(const char *pattern,
+                                     Callback callback) && {
+    return std::move(withCommand(pattern, std::move(callback)));
   }
 
-  enum class ParserState { number, decimal, failed };
-  ParserState state = ParserState::number;
+  /* Register a command with a typed callback. The parameters are matched to
+   * the placeholders of the pattern in order, using the schemas registered so
+   * far.
+   */
+  template <typename F,
+            typename = std::enable_if_t<typed::isTyped<F, Arguments>>>
+  BasicCLI &withCommand(const char *pattern, F callback) & {
+    using Adapter = typed::AdapterFor<F>;
+    using Invoker = typename Adapter::template Invoker<F>;
+    std::array<uint8_t, Adapter::arity> index = {};
+    Command command(pattern, nullptr);
+    command.bind(m_schemas);
 
-  int numberPart = 0;
-  int decimalPart = 0;
-  int decimalDivider = 1;
-  for (; i < token.len(); i++) {
-    const char c = token.str()[i];
-    if (c == '.') {
-      if (state == ParserState::number) {
-        state = ParserState::decimal;
-      } else {
-        state = ParserState::failed;
+    const Tokens &tokens = command.patternTokens();
+    std::size_t count = 0;
+    for (SizeT i = 0; i < tokens.size(); i++) {
+      if (!command.isPlaceholder(i)) {
+        continue;
       }
-      continue;
+      const Tag tag =
+          command.isRest(i) ? constants::tagString : command.tag(m_schemas, i);
+      CLI_ASSERT(count < Adapter::arity,
+                 "callback has fewer parameters than placeholders");
+      CLI_ASSERT(typed::isCompatible(Adapter::tags[count], tag),
+                 "callback parameter doesn't match placeholder");
+      CLI_ASSERT(!command.isOptional(i) || Adapter::missing[count],
+                 "optional placeholders need std::optional parameters");
+      CLI_ASSERT(!command.isRest(i) || Adapter::views[count],
+                 "the rest of a line is a view, take it as Token");
+      if (count < Adapter::arity) {
+        index[count] = i;
+      }
+      count++;
     }
+    CLI_ASSERT(count == Adapter::arity,
+               "callback has more parameters than placeholders");
+
+    command = Command(pattern, Invoker(std::move(callback), index));
+    command.bind(m_schemas);
+    command.fixBindings();
+    return withCommand(command);
+  }
+  template <typename F,
+            typename = std::enable_if_t<typed::isTyped<F, Arguments>>>
+  BasicCLI withCommand(const char *pattern, F callback) && {
+    return std::move(withCommand(pattern, std::move(callback)));
+  }
+
+#ifdef CLI_HAS_STATIC_PATTERNS
+  template <patterns::FixedString Pattern>
+  constexpr BasicCLI &withCommand(Callback callback) & {
+    using P = patterns::Static<Pattern>;
+    static_assert(P::tokenCount <= Config::cmdTokensMax,
+                  "pattern has more than cmdTokensMax tokens");
+    return withCommand(Command(P::template tokens<Tokens>(), P::literalPrefix,
+                               P::template match<Tokens, Arguments>,
+                               callback));
+  }
+  template <patterns::FixedString Pattern>
+  constexpr BasicCLI withCommand(Callback callback) && {
+    return std::move(withCommand<Pattern>(callback));
+  }
 
-    if (str::isInt(c)) {
-      const int digit = str::toInt(c);
-      if (state == ParserState::number) {
-        numberPart = digit + 10 * numberPart;
+  template <patterns::FixedString Pattern, typename F>
+    requires typed::isTyped<F, Arguments>
+  BasicCLI &withCommand(F callback) & {
+    using P = patterns::Static<Pattern>;
+    using Adapter = typed::AdapterFor<F>;
+    static_assert(P::tokenCount <= Config::cmdTokensMax,
+                  "pattern has more than cmdTokensMax tokens");
+    static_assert(P::placeholderCount == Adapter::arity,
+                  "callback parameter count doesn't match the placeholders");
+    static_assert(
+        [] {
+          for (std::size_t i = 0; i < Adapter::arity; i++) {
+            if (!typed::isCompatible(Adapter::tags[i], P::placeholderTag(i))) {
+              return false;
+            }
+          }
+          return true;
+        }(),
+        "callback parameter doesn't match placeholder");
+    constexpr auto index = [] {
+      std::array<uint8_t, Adapter::arity> index = {};
+      for (std::size_t i = 0; i < Adapter::arity; i++) {
+        index[i] = P::placeholderIndex(i);
       }
-      if (state == ParserState::decimal) {
-        decimalPart = digit + 10 * decimalPart;
-        decimalDivider *= 10;
+      return index;
+    }();
+
+    using Invoker = typename Adapter::template Invoker<F>;
+    return withCommand(Command(P::template tokens<Tokens>(), P::literalPrefix,
+                               P::template match<Tokens, Arguments>,
+                               Invoker(std::move(callback), index)));
+  }
+  template <patterns::FixedString Pattern, typename F>
+    requires typed::isTyped<F, Arguments>
+  BasicCLI withCommand(F callback) && {
+    return std::move(withCommand<Pattern>(std::move(callback)));
+  }
+#endif
+
+  /* Runs the command matching input. Callbacks which take an OutputSink
+   * write to out, or to a sink which discards the output if there is none.
+   * out isn't flushed, so output of several lines can share a write.
+   */
+  bool run(const char *input) const {
+    OutputSink discard;
+    return run(input, discard);
+  }
+  bool run(const char *input, OutputSink &out) const {
+    if (input == nullptr) {
+      return false;
+    }
+
+    return run(input, std::strlen(input), out);
+  }
+
+  // Run input which isn't null terminated
+  bool run(const char *input, std::size_t len) const {
+    OutputSink discard;
+    return run(input, len, discard);
+  }
+  bool run(const char *input, std::size_t len, OutputSink &out) const {
+    if (input == nullptr) {
+      return false;
+    }
+
+    Tokens inputTokens;
+    bool tail;
+    if (!tokenize(input, len, inputTokens, tail)) {
+      m_stats.reject(Rejection::noMatch);
+      return false;
+    }
+    return run(inputTokens, tail, out);
+  }
+
+  /* Runs every line of buf through the CLI in one pass. Lines end with LF or
+   * CRLF, and the last line doesn't need a line ending. sink is called with
+   * the line number (starting at 1) and the result of every non-blank line.
+   * @return number of lines which matched a command
+   */
+  std::size_t runBatch(const char *buf, std::size_t len,
+                       ResultSink sink) const {
+    OutputSink discard;
+    std::size_t matched = 0;
+    std::size_t lineNumber = 0;
+    const char *const end = buf + len;
+    while (buf < end) {
+      const char *newline = static_cast<const char *>(
+          std::memchr(buf, '\n', static_cast<std::size_t>(end - buf)));
+      const char *lineEnd = newline != nullptr ? newline : end;
+      lineNumber++;
+
+      Tokens inputTokens;
+      bool tail;
+      if (!tokenize(buf, static_cast<std::size_t>(lineEnd - buf), inputTokens,
+                    tail)) {
+        m_stats.reject(Rejection::noMatch);
+        sink(lineNumber, false);
+      } else if (tail || inputTokens.size() > 0) {
+        const bool result = run(inputTokens, tail, discard);
+        matched += result ? 1 : 0;
+        sink(lineNumber, result);
       }
+      buf = newline != nullptr ? newline + 1 : end;
+    }
+    return matched;
+  }
 
-      continue;
+  bool run(const Tokens &inputTokens) const {
+    OutputSink discard;
+    return run(inputTokens, false, discard);
+  }
+  bool run(const Tokens &inputTokens, OutputSink &out) const {
+    return run(inputTokens, false, out);
+  }
+
+  /* Finds the command matching the input and parses its arguments without
+   * running it, ie. to run it later or on another thread. Input is tokenized
+   * like run does, so lines over the token limit only match rest tokens.
+   * @return the command, or nullptr if no command matched
+   */
+  const Command *match(const char *input, std::size_t len,
+                       Arguments &arguments) const {
+    if (input == nullptr) {
+      return nullptr;
     }
+    Tokens inputTokens;
+    bool tail;
+    if (!tokenize(input, len, inputTokens, tail)) {
+      return nullptr;
+    }
+    return match(inputTokens, tail, arguments);
+  }
 
-    state = ParserState::failed;
-    break;
+  // match for tokens which fit the limit, ie. from parsers::tokenize
+  const Command *match(const Tokens &inputTokens, Arguments &arguments) const {
+    return match(inputTokens, false, arguments);
   }
 
-  if (state == ParserState::failed) {
-    return false;
+  /* Passes every literal token or placeholder which can follow a partial
+   * line to sink. The last token is the prefix to complete unless the line
+   * ends with whitespace. Literals and the words of choice placeholders are
+   * only passed if they start with the prefix, other placeholders always.
+   * Lines which won't tokenize have no candidates. Use a CompletionSession
+   * to complete as the line is typed instead of from scratch.
+   */
+  void complete(const char *partialInput, CompletionSink sink) const {
+    if (partialInput == nullptr) {
+      return;
+    }
+    complete(partialInput, std::strlen(partialInput), sink);
   }
 
-  value = numberPart + static_cast<float>(decimalPart) / decimalDivider;
-  if (isNegative) {
-    value = -value;
+  void complete(const char *partialInput, std::size_t len,
+                CompletionSink sink) const {
+    BasicCompleter<Config> completer(*this);
+    Token prefix(partialInput + len, 0);
+    std::size_t start = 0;
+    std::size_t tokenLen = 0;
+    while (parsers::tokenSplitter(partialInput, len, start, tokenLen)) {
+      const Token token =
+          parsers::unquote(Token(partialInput + start, tokenLen));
+      start += tokenLen;
+      if (start >= len || partialInput[start] == 0) {
+        prefix = token;
+        break;
+      }
+      completer.advance(token);
+    }
+    // lines which won't tokenize, ie. with a quote still open, have none
+    const char *const end = partialInput + len;
+    const char *const rest = str::skipSpace(partialInput + start, end);
+    if (rest != end && *rest != 0) {
+      return;
+    }
+    completer.complete(prefix, sink);
   }
-  return true;
-}
 
-bool tokenSplitter(const char *input, SizeT &tokenStart, SizeT &tokenLen) {
-  // begin looking at tokenStart
-  while (std::isspace(*(input + tokenStart))) {
-    tokenStart++;
+  /* Writes a line per command and group. The help of the table is built as
+   * commands are registered, so this is a single write unless it exceeds
+   * Config::helpTextMax.
+   */
+  void getHelp(HelpWriter writer) const {
+    if (m_helpComplete) {
+      if (m_helpLen > 0) {
+        writer(m_helpText.data(), static_cast<int>(m_helpLen));
+      }
+      return;
+    }
+    for (SizeT i = 0; i < m_commands.size(); i++) {
+      m_commands[i].getHelp(writer);
+      writer("\n", 1);
+    }
+    for (SizeT i = 0; i < m_groups.size(); i++) {
+      const Token &prefix = m_groups[i].prefix;
+      writer(prefix.str(), static_cast<int>(prefix.len()));
+      writer(" ... \n", 6);
+    }
   }
-  if (*(input + tokenStart) == 0) {
-    return false;
+  void getHelp(OutputSink &out) const {
+    getHelp([&out](const char *text, int len) { out(text, len); });
+  }
+
+  /* Registers group, a CLI of its own, under a prefix token. Lines starting
+   * with the prefix are dispatched to the group with the prefix removed, and
+   * no command of this CLI sees them, so every level only searches its own
+   * tables. The help lists the group as "prefix ...", and a help command of
+   * the group lists its commands. Groups nest, and subsystems can build and
+   * test their group on their own, ie.
+   *   const auto pm = cli::CLI().withDefaultSchemas().withCommand(...);
+   *   const auto cli = cli::CLI().withGroup("pm", pm);
+   * The group is referenced rather than copied, so it must outlive this CLI
+   * and stay in place, with its stats and command cache shared by every CLI
+   * it is a group of. Temporaries can't be groups. Copies and moves of this
+   * CLI keep the reference, so they are safe, but moving the group isn't.
+   * The prefix must be a single literal token, and commands of this CLI
+   * can't start with it, as the group would take their lines.
+   */
+  CLI_CONSTEXPR BasicCLI &withGroup(const char *prefix,
+                                    const BasicCLI &group) & {
+    CLI_ASSERT(&group != this, "a CLI can't be a group of itself");
+    const Token token(prefix, std::char_traits<char>::length(prefix));
+    CLI_ASSERT(this->group(token) == nullptr, "prefix is taken by a group");
+    for (SizeT i = 0; i < m_commands.size(); i++) {
+      CLI_ASSERT(!startsWith(m_commands[i], token),
+                 "a command starts with the prefix of the group");
+    }
+    if (m_groups.push_back(Group{token, &group})) {
+      appendHelp(token.str(), token.len());
+      appendHelp(" ... \n", 6);
+    }
+    return *this;
+  }
+  CLI_CONSTEXPR BasicCLI withGroup(const char *prefix,
+                                   const BasicCLI &group) && {
+    return std::move(withGroup(prefix, group));
   }
+  // A temporary group would be gone by the time a line reaches it
+  BasicCLI &withGroup(const char *prefix, const BasicCLI &&group) & = delete;
+  BasicCLI withGroup(const char *prefix, const BasicCLI &&group) && = delete;
 
-  tokenLen = 0;
-  while (!std::isspace(*(input + tokenStart + tokenLen)) &&
-         *(input + tokenStart + tokenLen) != 0) {
-    tokenLen++;
+  /* Registers a command which writes the help to the output of the run. Its
+   * callback is bound to this CLI, so it also runs from match, a queue or an
+   * executor, and copies of the CLI rebind it.
+   */
+  CLI_CONSTEXPR BasicCLI &withHelpCommand(const char *pattern) & {
+    const SizeT count = m_commands.size();
+    withCommand(pattern, Callback(&runHelp, this));
+    if (m_commands.size() > count) {
+      m_helpCommand = count;
+    }
+    return *this;
+  }
+  CLI_CONSTEXPR BasicCLI withHelpCommand(const char *pattern) && {
+    return std::move(withHelpCommand(pattern));
   }
 
-  if (tokenLen == 0) {
-    return false;
+  /* Registers a command which writes the report of getStats to the output
+   * of the run, bound like the help command. Needs Config::stats.
+   */
+  BasicCLI &withStatsCommand(const char *pattern) & {
+    static_assert(Config::stats, "stats are disabled in the config");
+    const SizeT count = m_commands.size();
+    withCommand(pattern, Callback(&runStats, this));
+    if (m_commands.size() > count) {
+      m_statsCommand = count;
+    }
+    return *this;
+  }
+  BasicCLI withStatsCommand(const char *pattern) && {
+    return std::move(withStatsCommand(pattern));
   }
 
-  return true;
-}
+  const CLIStats &stats() const { return m_stats; }
 
-Argument argumentParser(const Schemas &schemas, const Token &commandToken,
-                        const Token &inputToken) {
-  CLI_ASSERT(commandToken.isValid(), "commandToken is invalid");
-  CLI_ASSERT(inputToken.isValid(), "inputToken is invalid");
+  // Hits and misses of the command cache, needs Config::commandCacheSize
+  const Cache &cache() const {
+    static_assert(Config::commandCacheSize > 0,
+                  "the command cache is disabled in the config");
+    return m_cache;
+  }
 
-  for (SizeT i = 0; i < schemas.size(); i++) {
-    if (!schemas[i].isSchema(commandToken)) {
-      continue;
+  /* Writes the hits of every command, the rejections and the non-empty
+   * latency buckets as "bucket:count" pairs. Needs Config::stats.
+   */
+  void getStats(HelpWriter writer) const {
+    static_assert(Config::stats, "stats are disabled in the config");
+    char digits[20];
+    const auto number = [&](uint64_t value) {
+      char *p = digits + sizeof(digits);
+      do {
+        *--p = static_cast<char>('0' + value % 10);
+        value /= 10;
+      } while (value != 0);
+      writer(p, static_cast<int>(digits + sizeof(digits) - p));
+    };
+    const auto text = [&](const char *str) {
+      writer(str, static_cast<int>(std::strlen(str)));
+    };
+
+    for (SizeT i = 0; i < m_commands.size(); i++) {
+      m_commands[i].getHelp(writer);
+      number(m_stats.hits(i));
+      text("\n");
     }
 
-    Argument arg;
-    if (!schemas[i].parse(inputToken, arg)) {
-      continue;
+    const char *const reasons[] = {"no_match", "token_limit", "schema_parse",
+                                   "tag_mismatch"};
+    text("rejected");
+    for (std::size_t r = 0; r < static_cast<std::size_t>(Rejection::count);
+         r++) {
+      text(" ");
+      text(reasons[r]);
+      text(" ");
+      number(m_stats.rejections(static_cast<Rejection>(r)));
+    }
+    text("\n");
+
+    const char *const phases[] = {"tokenize", "match", "callback"};
+    for (std::size_t p = 0; p < static_cast<std::size_t>(Phase::count); p++) {
+      text(phases[p]);
+      const auto &histogram = m_stats.latency(static_cast<Phase>(p));
+      for (std::size_t b = 0; b < histogram.size(); b++) {
+        if (histogram[b].load() != 0) {
+          text(" ");
+          number(b);
+          text(":");
+          number(histogram[b].load());
+        }
+      }
+      text("\n");
     }
-    return arg;
   }
+  void getStats(OutputSink &out) const {
+    getStats([&out](const char *text, int len) { out(text, len); });
+  }
+};
 
-  if (inputToken == commandToken) {
-    return Argument::text(inputToken);
+/* @struct Footprint
+ * Bytes per instance of a BasicCLI<Config>, to check configs against the
+ * memory budget of a target at compile time, ie.
+ *   static_assert(cli::Footprint<SmallConfig>::total <= 2048);
+ */
+template <typename Config> struct Footprint {
+  static constexpr std::size_t command = sizeof(BasicCommand<Config>);
+  static constexpr std::size_t commands =
+      sizeof(typename Types<Config>::Commands);
+  static constexpr std::size_t schemas = sizeof(typename Types<Config>::Schemas);
+  static constexpr std::size_t index = sizeof(BasicCommandIndex<Config>);
+  static constexpr std::size_t help = Config::helpTextMax;
+  static constexpr std::size_t total = sizeof(BasicCLI<Config>);
+  // stack used by run for the tokens and arguments of a line
+  static constexpr std::size_t run = sizeof(typename Types<Config>::Tokens) +
+                                     sizeof(typename Types<Config>::Arguments);
+};
+
+/* @class LineReader
+ * Assembles lines from input arriving a few bytes at a time, ie. from a UART
+ * or a socket. Lines end with CR, LF or CRLF, and backspace or DEL removes
+ * the previous character. Complete lines are null terminated in the internal
+ * buffer and passed on without further copies. Lines longer than N - 1
+ * characters or holding a null character are dropped, and empty lines are
+ * skipped. The buffer holds a single line rather than a ring of input, as a
+ * line which wrapped around a ring would need a copy to be passed on in one
+ * piece. It restarts at every line end, so each byte is copied once and
+ * nothing is ever moved.
+ */
+template <std::size_t N> class LineReader {
+  static_assert(N > 1, "LineReader needs room for a character and a null");
+
+  char m_line[N] = {};
+  std::size_t m_len = 0;
+  std::size_t m_dropped = 0;
+  // the line is dropped at its end
+  bool m_discard = false;
+  bool m_afterCr = false;
+
+  static bool isControl(char c) {
+    return c == '\r' || c == '\n' || c == '\b' || c == 0x7f || c == 0;
   }
 
-  return Argument();
-}
+  template <typename OnLine> void pass(OnLine &onLine) {
+    m_line[m_len] = 0;
+    if constexpr (std::is_invocable<OnLine &, const char *,
+                                    std::size_t>::value) {
+      onLine(static_cast<const char *>(m_line), m_len);
+    } else {
+      onLine(static_cast<const char *>(m_line));
+    }
+  }
 
-Tokens tokenParser(const char *str) {
-  Tokens tokens;
-  SizeT tokenStart = 0;
-  SizeT tokenLen = 0;
-  while (parsers::tokenSplitter(str, tokenStart, tokenLen)) {
-    tokens.push_back(Token(str + tokenStart, tokenLen));
-    tokenStart = tokenStart + tokenLen;
+public:
+  /* Feed a chunk of input. onLine(const char *line) or
+   * onLine(const char *line, std::size_t len) is called for every complete
+   * line, the line is valid until onLine returns.
+   * @return number of lines passed to onLine
+   */
+  template <typename OnLine>
+  std::size_t feed(const char *data, std::size_t len, OnLine &&onLine) {
+    std::size_t lines = 0;
+    std::size_t i = 0;
+    while (i < len) {
+      // copy runs of ordinary characters in one go
+      std::size_t end = i;
+      while (end < len && !isControl(data[end])) {
+        end++;
+      }
+      if (end > i) {
+        m_afterCr = false;
+        const std::size_t run = end - i;
+        if (m_discard || m_len + run > N - 1) {
+          m_discard = true;
+        } else {
+          std::memcpy(m_line + m_len, data + i, run);
+          m_len += run;
+        }
+        i = end;
+        continue;
+      }
+
+      const char c = data[i++];
+      if (c == 0) {
+        // run would see the line end at the null
+        m_afterCr = false;
+        m_discard = true;
+        continue;
+      }
+      if (c == '\b' || c == 0x7f) {
+        m_afterCr = false;
+        if (!m_discard && m_len > 0) {
+          m_len--;
+        }
+        continue;
+      }
+
+      // LF directly after CR ends the same line
+      const bool crlf = c == '\n' && m_afterCr;
+      m_afterCr = c == '\r';
+      if (crlf) {
+        continue;
+      }
+
+      if (m_discard) {
+        m_dropped++;
+      } else if (m_len > 0) {
+        pass(onLine);
+        lines++;
+      }
+      m_len = 0;
+      m_discard = false;
+    }
+    return lines;
   }
 
-  return tokens;
-}
-} // namespace parsers
+  // Feed a chunk of input and run every complete line through cli
+  template <typename Config>
+  std::size_t feed(const BasicCLI<Config> &cli, const char *data,
+                   std::size_t len) {
+    return feed(data, len, [&cli](const char *line, std::size_t lineLen) {
+      cli.run(line, lineLen);
+    });
+  }
 
-class Command {
-  Callback m_callback = nullptr;
-  Tokens m_patternTokens;
+  // Discard the partial line
+  void clear() {
+    m_len = 0;
+    m_discard = false;
+    m_afterCr = false;
+  }
+
+  // Number of lines dropped for being too long or holding a null character
+  std::size_t dropped() const { return m_dropped; }
+};
+
+/* @class BasicCompleter
+ * Completion state after the complete tokens of a line. advance moves one
+ * token down the command index and filters the commands whose literal prefix
+ * is already behind, so a token costs the branching of the line rather than
+ * the number of commands, and the line is never tokenized again.
+ */
+template <typename Config> class BasicCompleter {
+  using CLIType = BasicCLI<Config>;
+  using Index = BasicCommandIndex<Config>;
+  using SizeT = typename Config::SizeT;
+  using Command = typename Types<Config>::Command;
+
+  static constexpr SizeT npos = Index::npos;
+
+  const CLIType *m_root;
+  // the group the line entered, or the root
+  const CLIType *m_cli;
+  // index node of the tokens so far, npos once they left the index
+  SizeT m_node = Index::root;
+  SizeT m_depth = 0;
+  // commands past their literal prefix which accepted every later token
+  FixedVector<SizeT, Config::cmdCountMax, SizeT> m_live;
+
+  static bool startsWith(const Token &token, const Token &prefix) {
+    return prefix.len() <= token.len() &&
+           (prefix.len() == 0 ||
+            std::memcmp(token.str(), prefix.str(), prefix.len()) == 0);
+  }
+
+  void join(SizeT node) {
+    const Index &index = m_cli->m_index;
+    for (SizeT c = index.firstCommand(node); c != npos;
+         c = index.nextCommand(c)) {
+      m_live.push_back(c);
+    }
+  }
+
+  // Pattern token of a live command at the current depth, if it has one
+  const Token *next(SizeT live) const {
+    const auto &command = m_cli->m_commands[m_live[live]];
+    const SizeT i = command.patternIndex(m_depth);
+    return i != Command::literal ? &command.patternTokens()[i] : nullptr;
+  }
+
+  // Starts over at the root of m_cli
+  void enter() {
+    m_node = Index::root;
+    m_depth = 0;
+    m_live.clear();
+    join(Index::root);
+  }
 
 public:
-  Command() = default;
-  Command(const char *pattern, Callback callback)
-      : m_callback(callback), m_patternTokens(parsers::tokenParser(pattern)) {}
+  explicit BasicCompleter(const CLIType &cli) : m_root(&cli), m_cli(&cli) {
+    clear();
+  }
 
-  bool parse(const Schemas &schemas, const Tokens &inputTokens,
-             Arguments &args) const {
-    args.clear();
+  // Back to the start of a line
+  void clear() {
+    m_cli = m_root;
+    enter();
+  }
 
-    if (inputTokens.size() != m_patternTokens.size()) {
-      return false;
+  // Number of tokens advanced past since the line entered its last group
+  SizeT depth() const { return m_depth; }
+
+  // Moves past a complete token of the line
+  void advance(const Token &token) {
+    if (m_depth == 0) {
+      if (const CLIType *group = m_cli->group(token)) {
+        m_cli = group;
+        enter();
+        return;
+      }
     }
 
-    for (SizeT i = 0; i < m_patternTokens.size(); i++) {
-      const auto &commandToken = m_patternTokens[i];
-      const auto &inputToken = inputTokens[i];
-      const Argument arg =
-          parsers::argumentParser(schemas, commandToken, inputToken);
-      if (!arg.isValid()) {
-        return false;
+    SizeT kept = 0;
+    for (SizeT i = 0; i < m_live.size(); i++) {
+      const auto &command = m_cli->m_commands[m_live[i]];
+      if (command.accepts(m_cli->m_schemas, m_depth, token)) {
+        m_live[kept++] = m_live[i];
       }
-      args.push_back(arg);
     }
+    m_live.resize(kept);
 
-    return true;
+    if (m_node != npos) {
+      m_node = m_cli->m_index.child(m_node, token);
+      if (m_node != npos) {
+        join(m_node);
+      }
+    }
+    if (m_depth < npos) {
+      m_depth++;
+    }
   }
 
-  void run(const Arguments &args) const { m_callback(args); }
+  /* Passes the literal tokens starting with prefix and the placeholders
+   * which can follow the tokens so far to sink, each once.
+   */
+  void complete(const Token &prefix, CompletionSink sink) const {
+    const Index &index = m_cli->m_index;
+    if (m_node != npos) {
+      for (SizeT c = index.firstChild(m_node); c != npos;
+           c = index.nextSibling(c)) {
+        if (startsWith(index.literal(c), prefix)) {
+          sink(index.literal(c));
+        }
+      }
+    }
+    if (m_depth == 0) {
+      const auto &groups = m_cli->m_groups;
+      for (SizeT i = 0; i < groups.size(); i++) {
+        if (startsWith(groups[i].prefix, prefix) &&
+            index.child(Index::root, groups[i].prefix) == npos) {
+          sink(groups[i].prefix);
+        }
+      }
+    }
 
-  void getHelp(std::function<void(const char *, int)> writer) const {
-    for (SizeT i = 0; i < m_patternTokens.size(); i++) {
-      const auto &t = m_patternTokens[i];
-      writer(t.str(), t.len());
-      writer(" ", 1);
+    for (SizeT i = 0; i < m_live.size(); i++) {
+      const Token *candidate = next(i);
+      if (candidate == nullptr) {
+        continue;
+      }
+      const auto &command = m_cli->m_commands[m_live[i]];
+      const bool placeholder =
+          command.isPlaceholder(command.patternIndex(m_depth));
+      if (!placeholder && !startsWith(*candidate, prefix)) {
+        continue;
+      }
+      // passed already as a child or for an earlier command
+      bool seen = m_node != npos && index.child(m_node, *candidate) != npos;
+      for (SizeT j = 0; j < i && !seen; j++) {
+        seen = next(j) != nullptr && *next(j) == *candidate;
+      }
+      if (seen) {
+        continue;
+      }
+      if (placeholder && Choices::isChoice(*candidate)) {
+        Choices::forEachWord(*candidate, [&](std::size_t at, std::size_t len) {
+          const Token word(candidate->str() + at, len);
+          if (startsWith(word, prefix)) {
+            sink(word);
+          }
+        });
+      } else {
+        sink(*candidate);
+      }
     }
   }
 };
 
-/*
- *
+/* @class BasicCompletionSession
+ * Completion of a line as it is typed. Characters of the last token are only
+ * buffered and whitespace advances the completer past the token, so a
+ * keystroke costs at most one completer step. Quoted tokens end at their
+ * closing quote like in tokenSplitter, and while a quote is open or a closing
+ * quote is followed by more than whitespace there are no candidates. Deleting
+ * whitespace or a character of a quoted token replays the line. Lines are
+ * limited to N - 1 characters.
  */
-class CLI {
-  Commands m_commands;
-  Schemas m_schemas;
+template <typename Config, std::size_t N> class BasicCompletionSession {
+  static_assert(N > 1, "CompletionSession needs room for a character");
+
+  BasicCompleter<Config> m_completer;
+  char m_line[N] = {};
+  std::size_t m_len = 0;
+  // start of the token being typed
+  std::size_t m_tokenStart = 0;
+  bool m_quoted = false;
+  bool m_backslash = false;
+  // a quote was just closed, the next character must be whitespace
+  bool m_closed = false;
+  bool m_malformed = false;
+
+  void endToken(std::size_t tokenEnd) {
+    if (tokenEnd > m_tokenStart) {
+      m_completer.advance(parsers::unquote(
+          Token(m_line + m_tokenStart, tokenEnd - m_tokenStart)));
+    }
+    m_tokenStart = m_len;
+  }
 
 public:
-  CLI withDefaultSchemas() {
-    return std::move(withSchema(schemaInteger)
-                         .withSchema(schemaFloat)
-                         .withSchema(schemaText));
+  explicit BasicCompletionSession(const BasicCLI<Config> &cli)
+      : m_completer(cli) {}
+
+  /* Appends a character, whitespace ends the token being typed.
+   * @return false if the line is full or c is a null character
+   */
+  bool push(char c) {
+    if (m_len >= N - 1 || c == 0) {
+      return false;
+    }
+    m_line[m_len++] = c;
+    if (m_malformed) {
+      return true;
+    }
+    if (m_closed) {
+      m_closed = false;
+      if (!str::isSpace(c)) {
+        m_malformed = true;
+        return true;
+      }
+    }
+    if (m_quoted) {
+      if (m_backslash) {
+        m_backslash = false;
+      } else if (c == '\\') {
+        m_backslash = true;
+      } else if (c == m_line[m_tokenStart]) {
+        m_quoted = false;
+        m_closed = true;
+        endToken(m_len);
+      }
+    } else if (m_len - 1 == m_tokenStart && str::isQuote(c)) {
+      m_quoted = true;
+    } else if (str::isSpace(c)) {
+      endToken(m_len - 1);
+    }
+    return true;
   }
 
-  CLI withSchema(Schema schema) {
-    m_schemas.push_back(schema);
-    return std::move(*this);
+  // Removes the last character, like backspace
+  void pop() {
+    if (m_len == 0) {
+      return;
+    }
+    m_len--;
+    if (m_len >= m_tokenStart && !m_quoted && !m_malformed) {
+      return;
+    }
+
+    const std::size_t len = m_len;
+    clear();
+    for (std::size_t i = 0; i < len; i++) {
+      push(m_line[i]);
+    }
+  }
+
+  void clear() {
+    m_completer.clear();
+    m_len = 0;
+    m_tokenStart = 0;
+    m_quoted = false;
+    m_backslash = false;
+    m_closed = false;
+    m_malformed = false;
   }
-  CLI withSchema(const char *pattern, TokenParser parser) {
-    return withSchema(Schema(pattern, parser));
+
+  // Candidates for the token being typed, see BasicCLI::complete
+  void complete(CompletionSink sink) const {
+    if (m_quoted || m_malformed) {
+      return;
+    }
+    m_completer.complete(parsers::unquote(Token(m_line + m_tokenStart,
+                                                m_len - m_tokenStart)),
+                         sink);
   }
 
-  CLI withCommand(const char *pattern, Callback callback) {
-    m_commands.push_back(Command(pattern, callback));
-    return std::move(*this);
+  // The line so far, not null terminated
+  const char *line() const { return m_line; }
+  std::size_t len() const { return m_len; }
+};
+
+/* @class BasicDeferredQueue
+ * Parses input where it arrives, ie. in an interrupt handler, and defers the
+ * callbacks to the main loop. post parses a line and stores the matched
+ * command with its arguments in a ring of N entries, and poll runs them in
+ * order. One thread or interrupt may post while another polls, without locks
+ * or allocations. Lines posted to a full queue are dropped and counted.
+ */
+template <typename Config, std::size_t N> class BasicDeferredQueue {
+  static_assert(N > 0 && (N & (N - 1)) == 0, "N must be a power of two");
+  static_assert(!Config::argTextView,
+                "deferred arguments outlive the input, they can't be views");
+  static_assert(std::atomic<std::size_t>::is_always_lock_free,
+                "the queue needs lock-free atomics");
+
+  using CLIType = BasicCLI<Config>;
+  using Arguments = typename CLIType::Arguments;
+  using Command = typename CLIType::Command;
+
+  struct Entry {
+    const Command *command = nullptr;
+    Arguments arguments;
+  };
+
+  const CLIType &m_cli;
+  std::array<Entry, N> m_entries;
+  // free running counters, written by the consumer and the producer
+  std::atomic<std::size_t> m_head{0};
+  std::atomic<std::size_t> m_tail{0};
+  std::atomic<std::size_t> m_dropped{0};
+
+public:
+  explicit BasicDeferredQueue(const CLIType &cli) : m_cli(cli) {}
+
+  /* Producer side. Parses input into the next free entry. Commands taking
+   * the rest of a line can't be deferred, their argument is a view into
+   * input.
+   * @return false if no command matched or the queue is full
+   */
+  bool post(const char *input) {
+    if (input == nullptr) {
+      return false;
+    }
+    return post(input, std::strlen(input));
   }
 
-  bool run(const char *input) const {
+  bool post(const char *input, std::size_t len) {
     if (input == nullptr) {
       return false;
     }
 
-    Tokens inputTokens = parsers::tokenParser(input);
-    for (int i = 0; i < m_commands.size(); i++) {
-      Arguments arguments;
-      if (m_commands[i].parse(m_schemas, inputTokens, arguments)) {
-        m_commands[i].run(arguments);
-        return true;
-      }
+    const std::size_t tail = m_tail.load(std::memory_order_relaxed);
+    if (tail - m_head.load(std::memory_order_acquire) == N) {
+      m_dropped.store(m_dropped.load(std::memory_order_relaxed) + 1,
+                      std::memory_order_relaxed);
+      return false;
     }
 
-    return false;
+    Entry &entry = m_entries[tail % N];
+    entry.command = m_cli.match(input, len, entry.arguments);
+    if (entry.command == nullptr || entry.command->hasRest()) {
+      return false;
+    }
+    m_tail.store(tail + 1, std::memory_order_release);
+    return true;
   }
 
-  void getHelp(std::function<void(const char *, int)> writer) const {
-    for (int i = 0; i < m_commands.size(); i++) {
-      m_commands[i].getHelp(writer);
-      writer("\n", 1);
+  /* Consumer side. Runs up to max queued commands in the order they were
+   * posted, their output is discarded.
+   * @return number of commands run
+   */
+  std::size_t poll(std::size_t max = N) {
+    OutputSink discard;
+    return poll(discard, max);
+  }
+
+  // Consumer side, with the output of the commands written to out
+  std::size_t poll(OutputSink &out, std::size_t max = N) {
+    std::size_t head = m_head.load(std::memory_order_relaxed);
+    const std::size_t tail = m_tail.load(std::memory_order_acquire);
+    std::size_t count = 0;
+    for (; head != tail && count < max; head++, count++) {
+      const Entry &entry = m_entries[head % N];
+      entry.command->run(entry.arguments, out);
+      // the entry may be reused once head moves past it
+      m_head.store(head + 1, std::memory_order_release);
     }
+    return count;
+  }
+
+  // Number of commands queued, exact on the consumer side
+  std::size_t size() const {
+    return m_tail.load(std::memory_order_acquire) -
+           m_head.load(std::memory_order_acquire);
+  }
+
+  // Number of lines dropped because the queue was full
+  std::size_t dropped() const {
+    return m_dropped.load(std::memory_order_relaxed);
   }
 };
+
+using Completer = BasicCompleter<DefaultConfig>;
+template <std::size_t N>
+using CompletionSession = BasicCompletionSession<DefaultConfig, N>;
+template <std::size_t N>
+using DeferredQueue = BasicDeferredQueue<DefaultConfig, N>;
 } // namespace cli
 
 #endif
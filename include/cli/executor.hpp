@@ -0,0 +1,224 @@
+#ifndef CLI_EXECUTOR_HPP_
+#define CLI_EXECUTOR_HPP_
+
+/* @file Running matched commands on a pool of worker threads. Input is parsed
+ * on the thread which submits it, and the callback runs on a worker with the
+ * parsed arguments. Unlike the CLI itself this allocates, so it is meant for
+ * servers rather than microcontrollers.
+ */
+
+#include <cli/cli.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace cli {
+
+/* @class BasicExecutor
+ * Work-stealing thread pool for the callbacks of a CLI. Every worker has its
+ * own queue, submitted jobs are spread over the queues, and idle workers take
+ * jobs from the back of the other queues. Jobs may run in any order and
+ * concurrently, so the callbacks have to be thread-safe. The CLI must outlive
+ * the executor.
+ */
+template <typename Config> class BasicExecutor {
+  using CLIType = BasicCLI<Config>;
+  using Arguments = typename CLIType::Arguments;
+  using Command = typename CLIType::Command;
+
+  struct Job {
+    const Command *command = nullptr;
+    Arguments arguments;
+    // copy of the input for string views, with argTextView or a rest token
+    std::unique_ptr<char[]> line;
+    OutputSink *out = nullptr;
+  };
+
+  struct Worker {
+    std::mutex mutex;
+    std::deque<Job> jobs;
+  };
+
+  const CLIType &m_cli;
+  std::vector<std::unique_ptr<Worker>> m_workers;
+  std::vector<std::thread> m_threads;
+  std::atomic<std::size_t> m_next{0};
+  std::atomic<std::size_t> m_queued{0};
+  std::atomic<std::size_t> m_unfinished{0};
+  std::atomic<std::size_t> m_sleeping{0};
+  std::mutex m_mutex;
+  std::condition_variable m_wake;
+  std::condition_variable m_idle;
+  bool m_stop = false;
+
+  bool pop(std::size_t self, Job &job) {
+    Worker &worker = *m_workers[self];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if (worker.jobs.empty()) {
+      return false;
+    }
+    job = std::move(worker.jobs.front());
+    worker.jobs.pop_front();
+    return true;
+  }
+
+  bool steal(std::size_t self, Job &job) {
+    for (std::size_t i = 1; i < m_workers.size(); i++) {
+      Worker &victim = *m_workers[(self + i) % m_workers.size()];
+      std::lock_guard<std::mutex> lock(victim.mutex);
+      if (!victim.jobs.empty()) {
+        job = std::move(victim.jobs.back());
+        victim.jobs.pop_back();
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void work(std::size_t self) {
+    while (true) {
+      Job job;
+      if (pop(self, job) || steal(self, job)) {
+        m_queued--;
+        if (job.out != nullptr) {
+          job.command->run(job.arguments, *job.out);
+        } else {
+          job.command->run(job.arguments);
+        }
+        if (--m_unfinished == 0) {
+          std::lock_guard<std::mutex> lock(m_mutex);
+          m_idle.notify_all();
+        }
+        continue;
+      }
+
+      std::unique_lock<std::mutex> lock(m_mutex);
+      // submit checks m_sleeping after queueing, so either it sees this
+      // worker asleep or the worker sees the job
+      m_sleeping++;
+      m_wake.wait(lock, [this] { return m_stop || m_queued > 0; });
+      m_sleeping--;
+      if (m_stop && m_queued == 0) {
+        return;
+      }
+    }
+  }
+
+public:
+  /* @param threads is the number of workers, 0 uses one per hardware thread
+   */
+  explicit BasicExecutor(const CLIType &cli, std::size_t threads = 0)
+      : m_cli(cli) {
+    if (threads == 0) {
+      threads = std::thread::hardware_concurrency();
+    }
+    if (threads == 0) {
+      threads = 1;
+    }
+    for (std::size_t i = 0; i < threads; i++) {
+      m_workers.push_back(std::make_unique<Worker>());
+    }
+    for (std::size_t i = 0; i < threads; i++) {
+      m_threads.emplace_back([this, i] { work(i); });
+    }
+  }
+
+  BasicExecutor(const BasicExecutor &) = delete;
+  BasicExecutor &operator=(const BasicExecutor &) = delete;
+
+  // Runs the jobs which are still queued before joining the workers
+  ~BasicExecutor() {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stop = true;
+    }
+    m_wake.notify_all();
+    for (std::thread &thread : m_threads) {
+      thread.join();
+    }
+  }
+
+  /* Parses input on the calling thread and queues the matched command. Safe
+   * to call from any number of threads.
+   * @return false if no command matched
+   */
+  bool submit(const char *input) {
+    if (input == nullptr) {
+      return false;
+    }
+    return submit(input, std::strlen(input));
+  }
+
+  bool submit(const char *input, std::size_t len) {
+    return submit(input, len, nullptr);
+  }
+
+  /* Like submit, with the output of the callback written to out. Jobs may
+   * run concurrently, so out must be safe to write from several workers, and
+   * outlive the job.
+   */
+  bool submit(const char *input, std::size_t len, OutputSink &out) {
+    return submit(input, len, &out);
+  }
+
+  // Blocks until every job submitted so far has run
+  void wait() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idle.wait(lock, [this] { return m_unfinished == 0; });
+  }
+
+private:
+  bool submit(const char *input, std::size_t len, OutputSink *out) {
+    if (input == nullptr) {
+      return false;
+    }
+
+    Job job;
+    job.out = out;
+    const auto parse = [&] {
+      job.command = m_cli.match(input, len, job.arguments);
+    };
+    const auto copyLine = [&] {
+      job.line.reset(new char[len + 1]);
+      std::memcpy(job.line.get(), input, len);
+      job.line[len] = 0;
+      input = job.line.get();
+    };
+    if constexpr (Config::argTextView) {
+      copyLine();
+    }
+    parse();
+    if (job.command == nullptr) {
+      return false;
+    }
+    // the rest of a line is a view in copy mode too
+    if (!Config::argTextView && job.command->hasRest()) {
+      copyLine();
+      parse();
+    }
+
+    m_unfinished++;
+    Worker &worker = *m_workers[m_next++ % m_workers.size()];
+    {
+      std::lock_guard<std::mutex> lock(worker.mutex);
+      worker.jobs.push_back(std::move(job));
+    }
+    m_queued++;
+    if (m_sleeping > 0) {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_wake.notify_one();
+    }
+    return true;
+  }
+};
+
+using Executor = BasicExecutor<DefaultConfig>;
+
+} // namespace cli
+
+#endif
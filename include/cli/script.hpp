@@ -0,0 +1,82 @@
+#ifndef CLI_SCRIPT_HPP_
+#define CLI_SCRIPT_HPP_
+
+/* @file Running script files through a CLI on POSIX systems. The file is
+ * memory mapped and fed through CLI::runBatch without copying it.
+ */
+
+#include <cli/cli.hpp>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace cli {
+
+/* @class MappedFile
+ * Read-only memory mapping of a whole file.
+ */
+class MappedFile {
+  const char *m_data = nullptr;
+  std::size_t m_size = 0;
+  bool m_valid = false;
+
+public:
+  explicit MappedFile(const char *path) {
+    const int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+      return;
+    }
+
+    struct stat info;
+    if (::fstat(fd, &info) != 0) {
+      ::close(fd);
+      return;
+    }
+
+    m_size = static_cast<std::size_t>(info.st_size);
+    if (m_size > 0) {
+      void *data = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data == MAP_FAILED) {
+        ::close(fd);
+        m_size = 0;
+        return;
+      }
+      ::madvise(data, m_size, MADV_SEQUENTIAL);
+      m_data = static_cast<const char *>(data);
+    }
+    ::close(fd);
+    m_valid = true;
+  }
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  ~MappedFile() {
+    if (m_data != nullptr) {
+      ::munmap(const_cast<char *>(m_data), m_size);
+    }
+  }
+
+  bool isValid() const { return m_valid; }
+  const char *data() const { return m_data; }
+  std::size_t size() const { return m_size; }
+};
+
+/* Runs every line of the file at path through cli.
+ * @return number of lines which matched a command, or -1 if the file
+ * couldn't be read
+ */
+template <typename Config>
+long runScript(const BasicCLI<Config> &cli, const char *path, ResultSink sink) {
+  const MappedFile file(path);
+  if (!file.isValid()) {
+    return -1;
+  }
+  return static_cast<long>(cli.runBatch(file.data(), file.size(), sink));
+}
+
+} // namespace cli
+
+#endif
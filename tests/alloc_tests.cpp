@@ -0,0 +1,76 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <cli/cli.hpp>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+std::atomic<bool> counting{false};
+std::atomic<int> allocations{0};
+
+struct CountAllocations {
+  CountAllocations() {
+    allocations = 0;
+    counting = true;
+  }
+  ~CountAllocations() { counting = false; }
+};
+} // namespace
+
+void *operator new(std::size_t size) {
+  if (counting) {
+    allocations++;
+  }
+  void *ptr = std::malloc(size == 0 ? 1 : size);
+  if (ptr == nullptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, std::size_t) noexcept { std::free(ptr); }
+
+TEST_CASE("CLI construction and run don't allocate", "[alloc]") {
+  struct Limits {
+    int min = 0;
+    int max = 0;
+    int calls = 0;
+  } limits;
+  // larger than the std::function small buffer of common implementations
+  struct Payload {
+    char data[16] = "payload";
+  } payload;
+  int helpLength = 0;
+  bool ok = true;
+
+  {
+    CountAllocations scope;
+    const auto cli =
+        cli::CLI()
+            .withDefaultSchemas()
+            .withCommand("pm lim vin ?i ?i",
+                         [&limits, payload](cli::Arguments args) {
+                           limits.min = args[3].get<int>();
+                           limits.max = args[4].get<int>();
+                           limits.calls += payload.data[0] == 'p';
+                         })
+            .withCommand("typed ?i ?i", [&limits](int min, int max) {
+              limits.min = min;
+              limits.max = max;
+            });
+
+    ok &= cli.run("pm lim vin 3 5");
+    ok &= cli.run("typed 7 9");
+    ok &= !cli.run("no such command");
+    cli.getHelp([&](const char *text, int len) { helpLength += len; });
+  }
+
+  REQUIRE(allocations == 0);
+  REQUIRE(ok);
+  REQUIRE(limits.calls == 1);
+  REQUIRE(limits.min == 7);
+  REQUIRE(limits.max == 9);
+  REQUIRE(helpLength > 0);
+}
@@ -1,7 +1,20 @@
 #include <catch2/catch_test_macros.hpp>
 
 #include <cli/cli.hpp>
+#if defined(__unix__)
+#include <cli/script.hpp>
+#endif
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
 #include <limits>
+#include <optional>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <vector>
 
 TEST_CASE("usage through CLI class", "[cli]") {
   using cli::Arguments;
@@ -239,3 +252,1558 @@ TEST_CASE("string parser", "[cli]") {
     REQUIRE(wasEqual);
   }
 };
+
+TEST_CASE("dispatch through the prefix index", "[cli]") {
+  using cli::Arguments;
+  using cli::CLI;
+
+  int called = -1;
+  const auto cli =
+      CLI()
+          .withDefaultSchemas()
+          .withCommand("set ?s", [&](Arguments args) { called = 0; })
+          .withCommand("set voltage", [&](Arguments args) { called = 1; })
+          .withCommand("set current ?i", [&](Arguments args) { called = 2; })
+          .withCommand("?i plus ?i", [&](Arguments args) { called = 3; })
+          .withCommand("get voltage", [&](Arguments args) { called = 4; })
+          .withCommand("get ?i", [&](Arguments args) { called = 5; });
+
+  SECTION("first registered command wins across trie depths") {
+    REQUIRE(cli.run("set voltage"));
+    REQUIRE(called == 0);
+    REQUIRE(cli.run("get voltage"));
+    REQUIRE(called == 4);
+  }
+
+  SECTION("commands attached to deeper nodes") {
+    REQUIRE(cli.run("set current 3"));
+    REQUIRE(called == 2);
+    REQUIRE(cli.run("get 3"));
+    REQUIRE(called == 5);
+  }
+
+  SECTION("commands starting with a placeholder") {
+    REQUIRE(cli.run("1 plus 2"));
+    REQUIRE(called == 3);
+  }
+
+  SECTION("misses") {
+    REQUIRE(!cli.run("set current x"));
+    REQUIRE(!cli.run("get"));
+    REQUIRE(!cli.run("1 minus 2"));
+    REQUIRE(called == -1);
+  }
+}
+
+TEST_CASE("schemas registered after commands", "[cli]") {
+  int value = 0;
+  const auto cli =
+      cli::CLI()
+          .withCommand("test ?i",
+                       [&](cli::Arguments args) { value = args[1].get<int>(); })
+          .withDefaultSchemas();
+
+  REQUIRE(cli.run("test 7"));
+  REQUIRE(value == 7);
+}
+
+#ifdef CLI_HAS_STATIC_PATTERNS
+TEST_CASE("compile-time patterns", "[cli]") {
+  int lim1 = 0, lim2 = 0;
+  float ratio = 0.0f;
+  bool wasSetByCallback = false;
+  const auto cli =
+      cli::CLI()
+          .withDefaultSchemas()
+          .withCommand<"pm lim vin ?i ?i">([&](cli::Arguments args) {
+            lim1 = args[3].get<int>();
+            lim2 = args[4].get<int>();
+          })
+          .withCommand<"  ratio   set ?f ">(
+              [&](cli::Arguments args) { ratio = args[2].get<float>(); })
+          .withCommand<"hello">(
+              [&](cli::Arguments args) { wasSetByCallback = true; });
+
+  SECTION("matches like runtime patterns") {
+    REQUIRE(cli.run("pm lim vin 3 -5"));
+    REQUIRE(lim1 == 3);
+    REQUIRE(lim2 == -5);
+    REQUIRE(cli.run("ratio set 0.5"));
+    REQUIRE(ratio == 0.5f);
+    REQUIRE(cli.run("hello"));
+    REQUIRE(wasSetByCallback);
+  }
+
+  SECTION("mismatches") {
+    REQUIRE(!cli.run("pm lim vin 3"));
+    REQUIRE(!cli.run("pm lim vin 3 x"));
+    REQUIRE(!cli.run("pm lim vi 3 5"));
+    REQUIRE(!cli.run("hello there"));
+    REQUIRE(!wasSetByCallback);
+  }
+
+  SECTION("placeholders work without registered schemas") {
+    int value = 0;
+    const auto bare = cli::CLI().withCommand<"?i">(
+        [&](cli::Arguments args) { value = args[0].get<int>(); });
+    REQUIRE(bare.run("12"));
+    REQUIRE(value == 12);
+  }
+}
+#endif
+
+TEST_CASE("typed callbacks", "[cli]") {
+  int lim1 = 0, lim2 = 0;
+  float ratio = 0.0f;
+  const char *name = "";
+  bool wasSetByCallback = false;
+  const auto cli =
+      cli::CLI()
+          .withDefaultSchemas()
+          .withCommand("pm lim vin ?i ?i",
+                       [&](int min, int max) {
+                         lim1 = min;
+                         lim2 = max;
+                       })
+          .withCommand("ratio ?s ?f",
+                       [&](const char *n, float r) {
+                         name = n;
+                         ratio = r;
+                       })
+          .withCommand("hello", [&]() { wasSetByCallback = true; });
+
+  REQUIRE(cli.run("pm lim vin 3 5"));
+  REQUIRE(lim1 == 3);
+  REQUIRE(lim2 == 5);
+  REQUIRE(cli.run("ratio x 0.5"));
+  REQUIRE(ratio == 0.5f);
+  REQUIRE(std::string(name) == "x");
+  REQUIRE(cli.run("hello"));
+  REQUIRE(wasSetByCallback);
+  REQUIRE(!cli.run("pm lim vin 3 x"));
+
+  SECTION("mismatching signatures are rejected at registration") {
+    REQUIRE_THROWS(cli::CLI().withDefaultSchemas().withCommand(
+        "pm lim vin ?i ?i", [](int min) {}));
+    REQUIRE_THROWS(cli::CLI().withDefaultSchemas().withCommand(
+        "pm lim vin ?i ?i", [](int min, float max) {}));
+  }
+
+#ifdef CLI_HAS_STATIC_PATTERNS
+  SECTION("compile-time pattern") {
+    const auto cli2 = cli::CLI().withCommand<"lim ?i ?f">(
+        [&](int min, float r) {
+          lim1 = min;
+          ratio = r;
+        });
+    REQUIRE(cli2.run("lim 7 1.5"));
+    REQUIRE(lim1 == 7);
+    REQUIRE(ratio == 1.5f);
+  }
+#endif
+}
+
+TEST_CASE("long string arguments are truncated and terminated", "[cli]") {
+  std::string text;
+  cli::Token token;
+  const auto cli = cli::CLI().withDefaultSchemas().withCommand(
+      "echo ?s", [&](cli::Arguments args) {
+        text = args[1].getString();
+        token = args[1].getToken();
+      });
+
+  REQUIRE(cli.run("echo 0123456789abcdefghij"));
+  REQUIRE(text == std::string("0123456789abcdefghij", CLI_ARG_MAX_TEXT_LEN - 1));
+  REQUIRE(token.len() == CLI_ARG_MAX_TEXT_LEN - 1);
+}
+
+namespace {
+long twice(long value) { return 2 * value; }
+} // namespace
+
+TEST_CASE("inplace function from functions", "[cli]") {
+  // a function whose signature differs goes through the callable constructor
+  const cli::InplaceFunction<int(int)> byReference(twice);
+  REQUIRE(byReference(21) == 42);
+  long (*pointer)(long) = nullptr;
+  const cli::InplaceFunction<int(int)> null(pointer);
+  REQUIRE(!null);
+  pointer = twice;
+  const cli::InplaceFunction<int(int)> byPointer(pointer);
+  REQUIRE(byPointer(2) == 4);
+}
+
+TEST_CASE("line reader", "[cli]") {
+  std::vector<std::string> lines;
+  cli::LineReader<16> reader;
+  const auto collect = [&](const char *line) { lines.emplace_back(line); };
+  const auto feed = [&](const char *chunk) {
+    return reader.feed(chunk, std::strlen(chunk), collect);
+  };
+
+  SECTION("lines split across chunks and line endings") {
+    REQUIRE(feed("hel") == 0);
+    REQUIRE(feed("lo\r") == 1);
+    REQUIRE(feed("\nset 4") == 0);
+    REQUIRE(feed("2\nab\r\ncd\n\n") == 3);
+    REQUIRE(lines == std::vector<std::string>{"hello", "set 42", "ab", "cd"});
+  }
+
+  SECTION("backspace and delete") {
+    feed("hellp\bo\n");
+    feed("x\b\b\x7fok\n");
+    REQUIRE(lines == std::vector<std::string>{"hello", "ok"});
+  }
+
+  SECTION("overlong lines are dropped") {
+    feed("0123456789abcdef");
+    feed("ghij\nshort\n");
+    REQUIRE(lines == std::vector<std::string>{"short"});
+    REQUIRE(reader.dropped() == 1);
+    feed("0123456789abcde\n");
+    REQUIRE(lines.back() == "0123456789abcde");
+  }
+
+  SECTION("lines with a null character are dropped") {
+    const char input[] = "set 1\0 2\nok\n\0\n";
+    std::vector<std::size_t> lengths;
+    REQUIRE(reader.feed(input, sizeof(input) - 1,
+                        [&](const char *line, std::size_t len) {
+                          lines.emplace_back(line, len);
+                          lengths.push_back(len);
+                        }) == 1);
+    REQUIRE(lines == std::vector<std::string>{"ok"});
+    REQUIRE(lengths == std::vector<std::size_t>{2});
+    REQUIRE(reader.dropped() == 2);
+  }
+
+  SECTION("feeding a CLI") {
+    int value = 0;
+    const auto cli = cli::CLI().withDefaultSchemas().withCommand(
+        "set ?i", [&](int v) { value = v; });
+    const char input[] = "set 1\r\nset 2\r\nset";
+    REQUIRE(reader.feed(cli, input, sizeof(input) - 1) == 2);
+    REQUIRE(value == 2);
+    REQUIRE(reader.feed(cli, " 3\r", 3) == 1);
+    REQUIRE(value == 3);
+    // the null would end the line at "set 4" for run
+    REQUIRE(reader.feed(cli, "set 4\0 5\n", 9) == 0);
+    REQUIRE(value == 3);
+  }
+}
+
+TEST_CASE("batch execution", "[cli]") {
+  std::vector<int> values;
+  std::vector<std::pair<std::size_t, bool>> results;
+  const auto cli = cli::CLI().withDefaultSchemas().withCommand(
+      "set ?i", [&](int v) { values.push_back(v); });
+  const auto sink = [&](std::size_t line, bool matched) {
+    results.emplace_back(line, matched);
+  };
+
+  SECTION("lines, blank lines and line endings") {
+    const char script[] = "set 1\r\n\n  \nset x\nset 2\nset 3";
+    REQUIRE(cli.runBatch(script, sizeof(script) - 1, sink) == 3);
+    REQUIRE(values == std::vector<int>{1, 2, 3});
+    REQUIRE(results == std::vector<std::pair<std::size_t, bool>>{
+                           {1, true}, {4, false}, {5, true}, {6, true}});
+  }
+
+  SECTION("buffer isn't null terminated") {
+    const char script[] = {'s', 'e', 't', ' ', '4', '2'};
+    REQUIRE(cli.runBatch(script, 5, sink) == 1);
+    REQUIRE(values == std::vector<int>{4});
+  }
+
+#if defined(__unix__)
+  SECTION("memory mapped script") {
+    char path[] = "/tmp/cli_script_XXXXXX";
+    const int fd = mkstemp(path);
+    REQUIRE(fd >= 0);
+    const char script[] = "set 7\nset 8\nnope\n";
+    REQUIRE(write(fd, script, sizeof(script) - 1) == sizeof(script) - 1);
+    close(fd);
+
+    REQUIRE(cli::runScript(cli, path, sink) == 2);
+    REQUIRE(values == std::vector<int>{7, 8});
+    REQUIRE(results.back() == std::make_pair(std::size_t(3), false));
+    unlink(path);
+
+    REQUIRE(cli::runScript(cli, "/nonexistent/script", sink) == -1);
+  }
+#endif
+}
+
+TEST_CASE("numeric range and syntax", "[cli]") {
+  using cli::Token;
+  using cli::parsers::ParseError;
+  const auto token = [](const char *text) {
+    return Token(text, std::strlen(text));
+  };
+
+  SECTION("integer limits") {
+    int value = 0;
+    ParseError error;
+    REQUIRE(cli::parsers::parseInteger(token("2147483647"), value, error));
+    REQUIRE(value == std::numeric_limits<int>::max());
+    REQUIRE(cli::parsers::parseInteger(token("-2147483648"), value, error));
+    REQUIRE(value == std::numeric_limits<int>::min());
+    REQUIRE(cli::parsers::parseInteger(token("00000000000000000000042"), value));
+    REQUIRE(value == 42);
+    REQUIRE(cli::parsers::parseInteger(token("-123456789"), value));
+    REQUIRE(value == -123456789);
+
+    REQUIRE(!cli::parsers::parseInteger(token("2147483648"), value, error));
+    REQUIRE(error == ParseError::outOfRange);
+    REQUIRE(!cli::parsers::parseInteger(token("-99999999999999999999999"),
+                                        value, error));
+    REQUIRE(error == ParseError::outOfRange);
+    REQUIRE(!cli::parsers::parseInteger(token("99999999999999999999x"), value,
+                                        error));
+    REQUIRE(error == ParseError::invalid);
+    REQUIRE(!cli::parsers::parseInteger(token("-"), value, error));
+    REQUIRE(error == ParseError::invalid);
+    REQUIRE(!cli::parsers::parseInteger(token("+"), value));
+  }
+
+  SECTION("float syntax") {
+    float value = 0.0f;
+    ParseError error;
+    REQUIRE(cli::parsers::parseFloat(token("1e-3"), value));
+    REQUIRE(value == 1e-3f);
+    REQUIRE(cli::parsers::parseFloat(token("-2.5E+2"), value));
+    REQUIRE(value == -250.0f);
+    REQUIRE(cli::parsers::parseFloat(token(".5"), value));
+    REQUIRE(value == 0.5f);
+    REQUIRE(cli::parsers::parseFloat(token("1."), value));
+    REQUIRE(value == 1.0f);
+
+    for (const char *invalid : {".", "-.", "+", "1e", "1e+", "e5", "1.2.3",
+                                "1ee3", "0x10", "--1"}) {
+      INFO(invalid);
+      REQUIRE(!cli::parsers::parseFloat(token(invalid), value, error));
+      REQUIRE(error == ParseError::invalid);
+    }
+  }
+
+  SECTION("float precision and range") {
+    float value = 0.0f;
+    ParseError error;
+    // more fractional digits than fit an int used to overflow
+    REQUIRE(cli::parsers::parseFloat(token("0.1234567890123"), value));
+    REQUIRE(value == 0.1234567890123f);
+    REQUIRE(cli::parsers::parseFloat(token("3.4028234e38"), value));
+    REQUIRE(value == std::numeric_limits<float>::max());
+    REQUIRE(cli::parsers::parseFloat(
+        token("1.00000005960464477539062500000000001"), value));
+    REQUIRE(value == 1.00000012f); // just above the midpoint rounds up
+    REQUIRE(cli::parsers::parseFloat(token("1.000000059604644775390625"),
+                                     value));
+    REQUIRE(value == 1.0f); // exact midpoint rounds to even
+    REQUIRE(cli::parsers::parseFloat(token("1e-45"), value));
+    REQUIRE(value == std::numeric_limits<float>::denorm_min());
+    REQUIRE(cli::parsers::parseFloat(token("0e999999"), value));
+    REQUIRE(value == 0.0f);
+
+    REQUIRE(!cli::parsers::parseFloat(token("1e39"), value, error));
+    REQUIRE(error == ParseError::outOfRange);
+    REQUIRE(!cli::parsers::parseFloat(token("-1e-60"), value, error));
+    REQUIRE(error == ParseError::outOfRange);
+    REQUIRE(!cli::parsers::parseFloat(token("1e99999999999"), value, error));
+    REQUIRE(error == ParseError::outOfRange);
+  }
+}
+
+TEST_CASE("float parser agrees with strtof", "[cli]") {
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<int> digit(0, 9);
+  std::uniform_int_distribution<int> count(1, 24);
+  std::uniform_int_distribution<int> exponent(-50, 40);
+
+  for (int i = 0; i < 20000; i++) {
+    std::string text = i % 2 == 0 ? "" : "-";
+    for (int d = count(rng); d > 0; d--) {
+      text += static_cast<char>('0' + digit(rng));
+    }
+    if (i % 3 != 0) {
+      text += '.';
+      for (int d = count(rng); d > 0; d--) {
+        text += static_cast<char>('0' + digit(rng));
+      }
+    }
+    if (i % 4 == 0) {
+      text += "e" + std::to_string(exponent(rng));
+    }
+
+    const float expected = std::strtof(text.c_str(), nullptr);
+    const bool inRange = expected != 0.0f && std::isfinite(expected);
+    float value = 0.0f;
+    const bool parsed =
+        cli::parsers::parseFloat(cli::Token(text.c_str(), text.size()), value);
+    INFO(text);
+    if (inRange) {
+      REQUIRE(parsed);
+      REQUIRE(value == expected);
+    } else if (parsed) {
+      REQUIRE(value == expected); // zero mantissa
+    }
+  }
+}
+
+TEST_CASE("schemas bound at registration", "[cli]") {
+  const auto parseHex = [](const cli::Token &input, cli::Argument &result) {
+    int value = 0;
+    for (cli::SizeT i = 0; i < input.len(); i++) {
+      const char c = input.str()[i];
+      if (!std::isxdigit(static_cast<unsigned char>(c))) {
+        return false;
+      }
+      value = value * 16 + (cli::str::isInt(c) ? cli::str::toInt(c)
+                                               : std::tolower(c) - 'a' + 10);
+    }
+    result = cli::Argument::create(cli::constants::tagUser1, value);
+    return true;
+  };
+
+  SECTION("untyped commands bind late") {
+    int value = 0;
+    const auto cli =
+        cli::CLI()
+            .withCommand("reg ?x",
+                         [&](cli::Arguments args) {
+                           value = args[1].get<int>(cli::constants::tagUser1);
+                         })
+            .withSchema("?x", parseHex, cli::constants::tagUser1);
+    REQUIRE(cli.run("reg ff"));
+    REQUIRE(value == 255);
+    // placeholders still match themselves literally
+    REQUIRE(cli.run("reg ?x"));
+  }
+
+  SECTION("typed commands require their schemas up front") {
+    REQUIRE_THROWS(cli::CLI()
+                       .withDefaultSchemas()
+                       .withCommand("reg ?x ?i", [](int value) {})
+                       .withSchema("?x", parseHex));
+  }
+}
+
+namespace {
+struct TinyConfig : cli::DefaultConfig {
+  static constexpr std::size_t cmdCountMax = 2;
+  static constexpr std::size_t cmdTokensMax = 3;
+  static constexpr std::size_t trieNodesMax = 4;
+  static constexpr std::size_t argMaxTextLen = 8;
+  static constexpr std::size_t helpTextMax = 16;
+};
+
+struct ViewConfig : cli::DefaultConfig {
+  static constexpr bool argTextView = true;
+};
+
+struct CacheConfig : cli::DefaultConfig {
+  static constexpr std::size_t commandCacheSize = 4;
+};
+} // namespace
+
+TEST_CASE("per instance configs", "[cli]") {
+  static_assert(cli::Footprint<TinyConfig>::total <
+                    cli::Footprint<cli::DefaultConfig>::total / 2,
+                "a tiny config should pay for its own tables only");
+  static_assert(sizeof(cli::BasicArgument<ViewConfig>) <
+                sizeof(cli::Argument));
+
+  SECTION("capacities of the config") {
+    int calls = 0;
+    const auto tiny =
+        cli::BasicCLI<TinyConfig>()
+            .withDefaultSchemas()
+            .withCommand("a ?i", [&](int value) { calls += value; })
+            .withCommand("b", [&](cli::BasicCLI<TinyConfig>::Arguments) {
+              calls++;
+            })
+            .withCommand("c", [&](cli::BasicCLI<TinyConfig>::Arguments) {
+              calls++;
+            });
+    REQUIRE(tiny.run("a 5"));
+    REQUIRE(tiny.run("b"));
+    REQUIRE(!tiny.run("c")); // only room for two commands
+    REQUIRE(calls == 6);
+  }
+
+  SECTION("argument storage of the config") {
+    std::string text;
+    const auto tiny = cli::BasicCLI<TinyConfig>().withDefaultSchemas().withCommand(
+        "echo ?s", [&](const char *s) { text = s; });
+    REQUIRE(tiny.run("echo truncated"));
+    REQUIRE(text == "truncat");
+
+    const auto view = cli::BasicCLI<ViewConfig>().withDefaultSchemas().withCommand(
+        "echo ?s", [&](cli::Token t) { text.assign(t.str(), t.len()); });
+    REQUIRE(view.run("echo not_truncated"));
+    REQUIRE(text == "not_truncated");
+  }
+
+  SECTION("inputs longer than SizeT") {
+    static_assert(std::is_same<cli::SizeT, uint8_t>::value);
+    const std::string padding(300, ' ');
+    const std::string word(300, 'x');
+    int value = 0;
+    std::string text;
+    const auto view =
+        cli::BasicCLI<ViewConfig>().withDefaultSchemas().withCommand(
+            "set ?s ?i", [&](cli::Token t, int v) {
+              text.assign(t.str(), t.len());
+              value = v;
+            });
+
+    REQUIRE(view.run((padding + "set " + word + " 7").c_str()));
+    REQUIRE(text == word);
+    REQUIRE(value == 7);
+  }
+}
+
+namespace {
+// callback which counts its copies, moves aren't counted
+struct Counted {
+  static inline int copies = 0;
+  Counted() = default;
+  Counted(const Counted &) { copies++; }
+  Counted(Counted &&) = default;
+  Counted &operator=(const Counted &) = delete;
+  void operator()(const cli::Arguments &) const {}
+};
+} // namespace
+
+TEST_CASE("builder registers in place", "[cli]") {
+  int calls = 0;
+  cli::CLI cli;
+  cli::CLI &chained =
+      cli.withDefaultSchemas()
+          .withCommand("a", [&](cli::Arguments) { calls++; })
+          .withCommand("b ?i", [&](int value) { calls += value; });
+  REQUIRE(&chained == &cli);
+
+  for (int i = 0; i < 3; i++) {
+    cli.withCommand("c", [&](cli::Arguments) { calls += 10; });
+  }
+  REQUIRE(cli.run("a"));
+  REQUIRE(cli.run("b 4"));
+  REQUIRE(cli.run("c"));
+  REQUIRE(calls == 15);
+
+  // temporaries return a value, so a reference to the chain extends it
+  static_assert(
+      std::is_same<decltype(cli::CLI().withDefaultSchemas()), cli::CLI>::value);
+  const auto &extended = cli::CLI().withDefaultSchemas().withCommand(
+      "d ?i", [&](int value) { calls = value; });
+  REQUIRE(extended.run("d 7"));
+  REQUIRE(calls == 7);
+
+  // moving a chain moves the callbacks, so it copies them as often as
+  // registering on an lvalue does
+  const auto build = [](cli::CLI &target) {
+    target.withCommand("a", Counted{}).withCommand("b", Counted{});
+  };
+  Counted::copies = 0;
+  cli::CLI lvalue;
+  build(lvalue);
+  const int registration = Counted::copies;
+  Counted::copies = 0;
+  const auto moved = cli::CLI()
+                         .withCommand("a", Counted{})
+                         .withCommand("b", Counted{})
+                         .withDefaultSchemas()
+                         .withCommand("c", [](cli::Arguments) {});
+  REQUIRE(Counted::copies == registration);
+  REQUIRE(moved.run("a"));
+}
+
+TEST_CASE("lines over the token limit", "[cli]") {
+  using TinyCLI = cli::BasicCLI<TinyConfig>;
+  const auto tiny = TinyCLI().withDefaultSchemas().withCommand(
+      "set ?i ?i", [](TinyCLI::Arguments) {});
+  // three tokens fit, the fourth can't be dropped to match "set ?i ?i"
+  const char *const line = "set 1 2 3";
+  TinyCLI::Arguments arguments;
+  REQUIRE(tiny.match(line, 7, arguments) != nullptr);
+  REQUIRE(tiny.match(line, std::strlen(line), arguments) == nullptr);
+  REQUIRE(!tiny.run(line));
+
+  cli::BasicDeferredQueue<TinyConfig, 2> queue(tiny);
+  REQUIRE(!queue.post(line));
+  REQUIRE(queue.size() == 0);
+}
+
+TEST_CASE("deferred queue", "[cli]") {
+  std::vector<int> values;
+  const auto cli = cli::CLI().withDefaultSchemas().withCommand(
+      "set ?i", [&](int value) { values.push_back(value); });
+  cli::DeferredQueue<4> queue(cli);
+
+  REQUIRE(!queue.post("no such command"));
+  for (int i = 0; i < 5; i++) {
+    const std::string line = "set " + std::to_string(i);
+    REQUIRE(queue.post(line.c_str()) == (i < 4));
+  }
+  REQUIRE(queue.dropped() == 1);
+  REQUIRE(values.empty());
+
+  REQUIRE(queue.poll(3) == 3);
+  REQUIRE(values == std::vector<int>{0, 1, 2});
+  REQUIRE(queue.post("set 9"));
+  REQUIRE(queue.size() == 2);
+  REQUIRE(queue.poll() == 2);
+  REQUIRE(values == std::vector<int>{0, 1, 2, 3, 9});
+  REQUIRE(queue.poll() == 0);
+}
+
+TEST_CASE("help command outside of run", "[cli]") {
+  std::string written;
+  cli::BufferedOutput<16> out([&written](const char *text, int len) {
+    written.append(text, static_cast<std::size_t>(len));
+  });
+  auto built = cli::CLI().withDefaultSchemas();
+  built.withCommand("set ?i", [](int) {}).withHelpCommand("help");
+  // copies bind the help command to themselves
+  const auto cli = built;
+  built = cli::CLI();
+
+  cli::DeferredQueue<4> queue(cli);
+  REQUIRE(queue.post("help"));
+  REQUIRE(queue.poll() == 1);
+  REQUIRE(queue.post("help"));
+  REQUIRE(queue.poll(out) == 1);
+  out.flush();
+  REQUIRE(written == "set ?i \nhelp \n");
+
+  written.clear();
+  cli::Arguments args;
+  const auto *help =
+      cli.match(cli::parsers::tokenize<cli::CLI::Tokens>("help", 4), args);
+  REQUIRE(help != nullptr);
+  help->run(args, out);
+  out.flush();
+  REQUIRE(written == "set ?i \nhelp \n");
+}
+
+namespace {
+// every reading advances by one tick, so every phase takes one tick
+struct TickClock {
+  static inline uint64_t ticks = 0;
+  static uint64_t now() { return ticks++; }
+};
+
+struct StatsConfig : cli::DefaultConfig {
+  static constexpr bool stats = true;
+  static constexpr std::size_t cmdTokensMax = 4;
+  using StatsClock = TickClock;
+};
+} // namespace
+
+TEST_CASE("stats", "[cli]") {
+  static_assert(std::is_empty<cli::NoStats<cli::DefaultConfig>>::value,
+                "stats cost nothing when disabled");
+  using StatsCLI = cli::BasicCLI<StatsConfig>;
+
+  std::string report;
+  const auto cli =
+      StatsCLI()
+          .withDefaultSchemas()
+          .withCommand("set ?i", [](int) {})
+          .withCommand("get",
+                       [](StatsCLI::Arguments args) {
+                         args[0].get<int>(cli::constants::tagInt);
+                       })
+          .withStatsCommand("stats");
+  cli::BufferedOutput<64> out([&](const char *text, int len) {
+    report.append(text, static_cast<std::size_t>(len));
+  });
+
+  REQUIRE(cli.run("set 1"));
+  REQUIRE(cli.run("set 2"));
+  REQUIRE(cli.run("get"));
+  REQUIRE(!cli.run("set x"));
+  REQUIRE(!cli.run("unknown"));
+  REQUIRE(!cli.run("a b c d e"));
+
+  const auto &stats = cli.stats();
+  REQUIRE(stats.hits(0) == 2);
+  REQUIRE(stats.hits(1) == 1);
+  REQUIRE(stats.rejections(cli::Rejection::noMatch) == 1);
+  REQUIRE(stats.rejections(cli::Rejection::tokenLimit) == 1);
+  REQUIRE(stats.rejections(cli::Rejection::schemaParse) == 1);
+  REQUIRE(stats.rejections(cli::Rejection::tagMismatch) == 1);
+  REQUIRE(stats.latency(cli::Phase::tokenize)[1].load() == 6);
+  // lines over the token limit are matched too, for rest tokens
+  REQUIRE(stats.latency(cli::Phase::match)[1].load() == 6);
+  REQUIRE(stats.latency(cli::Phase::callback)[1].load() == 3);
+
+  REQUIRE(cli.run("stats", out));
+  out.flush();
+  REQUIRE(report == "set ?i 2\n"
+                    "get 1\n"
+                    "stats 1\n"
+                    "rejected no_match 1 token_limit 1 schema_parse 1 "
+                    "tag_mismatch 1\n"
+                    "tokenize 1:7\n"
+                    "match 1:7\n"
+                    "callback 1:3\n");
+
+  // queued, the stats command writes to the sink of the poll
+  report.clear();
+  cli::BasicDeferredQueue<StatsConfig, 2> queue(cli);
+  REQUIRE(queue.post("stats"));
+  REQUIRE(queue.poll(out) == 1);
+  out.flush();
+  REQUIRE(report.rfind("set ?i 2\nget 1\nstats 1\n", 0) == 0);
+}
+
+TEST_CASE("completion", "[cli]") {
+  const auto cli = cli::CLI()
+                       .withDefaultSchemas()
+                       .withCommand("help", [](cli::Arguments) {})
+                       .withCommand("pm lim vin ?i ?i", [](int, int) {})
+                       .withCommand("pm lim vout ?i ?i", [](int, int) {})
+                       .withCommand("pm reset", [](cli::Arguments) {})
+                       .withCommand("set ?i mode", [](int) {})
+                       .withCommand("set ?i speed ?f", [](int, float) {})
+                       .withCommand("set ?i mode ?s", [](int, const char *) {});
+
+  const auto collect = [](std::vector<std::string> &out) {
+    out.clear();
+    return [&out](const cli::Token &candidate) {
+      out.emplace_back(candidate.str(), candidate.len());
+    };
+  };
+  std::vector<std::string> out;
+  const auto complete = [&](const char *partial) {
+    cli.complete(partial, collect(out));
+    std::sort(out.begin(), out.end());
+    return out;
+  };
+  using Strings = std::vector<std::string>;
+
+  REQUIRE(complete("") == Strings{"help", "pm", "set"});
+  REQUIRE(complete("  p") == Strings{"pm"});
+  REQUIRE(complete("pm") == Strings{"pm"});
+  REQUIRE(complete("pm ") == Strings{"lim", "reset"});
+  REQUIRE(complete("pm lim v") == Strings{"vin", "vout"});
+  REQUIRE(complete("pm lim vin ") == Strings{"?i"});
+  REQUIRE(complete("pm lim vin 1 2 ").empty());
+  REQUIRE(complete("pm x ").empty());
+  REQUIRE(complete("set 5 ") == Strings{"mode", "speed"});
+  REQUIRE(complete("set 5 m") == Strings{"mode"});
+  REQUIRE(complete("set 5 mode ") == Strings{"?s"});
+  REQUIRE(complete("set x ").empty());
+  REQUIRE(complete("set ?i ") == Strings{"mode", "speed"});
+
+  SECTION("session") {
+    cli::CompletionSession<32> session(cli);
+    const auto type = [&](const char *text) {
+      for (; *text != 0; text++) {
+        REQUIRE(session.push(*text));
+      }
+      session.complete(collect(out));
+      std::sort(out.begin(), out.end());
+      return out;
+    };
+
+    REQUIRE(type("pm  l") == Strings{"lim"});
+    REQUIRE(type("im\t") == Strings{"vin", "vout"});
+    REQUIRE(type("vo") == Strings{"vout"});
+    session.pop();
+    session.pop();
+    session.pop();
+    REQUIRE(type("") == Strings{"lim"});
+    for (int i = 0; i < 5; i++) {
+      session.pop();
+    }
+    REQUIRE(type("") == Strings{"pm"});
+    REQUIRE(std::string(session.line(), session.len()) == "pm");
+
+    session.clear();
+    REQUIRE(type("set -3 sp") == Strings{"speed"});
+    REQUIRE(type("eed ") == Strings{"?f"});
+    REQUIRE(type(std::string(18, 'x').c_str()) == Strings{"?f"});
+    REQUIRE(!session.push('x'));
+  }
+
+#ifdef CLI_HAS_STATIC_PATTERNS
+  SECTION("compile-time patterns") {
+    auto led = cli::CLI().withCommand<"led ?i on">([](int) {});
+    led.complete("led ", collect(out));
+    REQUIRE(out == Strings{"?i"});
+    led.complete("led 3 ", collect(out));
+    REQUIRE(out == Strings{"on"});
+  }
+#endif
+}
+
+TEST_CASE("quoted tokens", "[cli]") {
+  std::string text;
+  int value = 0;
+  const auto cli =
+      cli::CLI()
+          .withDefaultSchemas()
+          .withCommand("echo ?s", [&](const char *t) { text = t; })
+          .withCommand("set ?i", [&](int v) { value = v; })
+          .withCommand("say ?s ?s", [&](const char *a, const char *b) {
+            text = std::string(a) + "|" + b;
+          });
+
+  REQUIRE(cli.run(R"(echo "hello world")"));
+  REQUIRE(text == "hello world");
+  REQUIRE(cli.run(R"(echo 'it\'s \\ "here"')"));
+  REQUIRE(text == R"(it's \ "here")");
+  REQUIRE(cli.run(R"(say "" 'a b')"));
+  REQUIRE(text == "|a b");
+  // backslashes are only escapes inside quotes
+  REQUIRE(cli.run(R"(echo a\b)"));
+  REQUIRE(text == R"(a\b)");
+
+  // quotes are removed before matching literals and parsing numbers
+  REQUIRE(cli.run(R"("set" '12')"));
+  REQUIRE(value == 12);
+  REQUIRE(cli.run(R"(set "-\3")"));
+  REQUIRE(value == -3);
+  REQUIRE(!cli.run(R"(set "1 2")"));
+  REQUIRE(!cli.run(R"("s\et" 1)"));
+
+  // quotes which aren't closed or are followed by more than whitespace
+  REQUIRE(!cli.run(R"(echo "abc)"));
+  REQUIRE(!cli.run(R"(echo "ab"cd)"));
+  REQUIRE(!cli.run(R"(say 'd\' e'f)"));
+  REQUIRE(cli.run(R"(say 'd\' e' f)"));
+  REQUIRE(text == "d' e|f");
+  cli::CLI::Arguments args;
+  REQUIRE(cli.match("echo 'abc", 9, args) == nullptr);
+  std::vector<bool> results;
+  const char script[] = "echo \"a\nset 1\n";
+  REQUIRE(cli.runBatch(script, sizeof(script) - 1,
+                       [&](std::size_t, bool result) {
+                         results.push_back(result);
+                       }) == 1);
+  REQUIRE(results == std::vector<bool>{false, true});
+
+  // escaped text longer than the argument is truncated while unescaping
+  const std::string longText = "echo \"" + std::string(100, 'x') + "\\\"\"";
+  REQUIRE(cli.run(longText.c_str()));
+  REQUIRE(text == std::string(CLI_ARG_MAX_TEXT_LEN - 1, 'x'));
+
+  std::vector<std::string> out;
+  cli.complete(R"("say" "a b" 'c d' )", [&](const cli::Token &candidate) {
+    out.emplace_back(candidate.str(), candidate.len());
+  });
+  REQUIRE(out.empty());
+  cli.complete(R"(say "a b" )", [&](const cli::Token &candidate) {
+    out.emplace_back(candidate.str(), candidate.len());
+  });
+  REQUIRE(out == std::vector<std::string>{"?s"});
+  // lines which won't tokenize have no candidates
+  out.clear();
+  for (const char *line : {R"(say "a)", R"(say "a"b)", R"(say "a"b )"}) {
+    cli.complete(line, [&](const cli::Token &candidate) {
+      out.emplace_back(candidate.str(), candidate.len());
+    });
+  }
+  REQUIRE(out.empty());
+
+  cli::CompletionSession<32> session(cli);
+  const auto candidates = [&] {
+    out.clear();
+    session.complete([&](const cli::Token &candidate) {
+      out.emplace_back(candidate.str(), candidate.len());
+    });
+    return out;
+  };
+  for (const char c : std::string(R"(say "a \"b" 'x)")) {
+    REQUIRE(session.push(c));
+  }
+  REQUIRE(candidates().empty());
+  session.push('\'');
+  REQUIRE(candidates().empty());
+  session.pop();
+  session.pop();
+  session.pop();
+  REQUIRE(candidates() == std::vector<std::string>{"?s"});
+
+  session.clear();
+  for (const char c : std::string(R"(say "a"b)")) {
+    REQUIRE(session.push(c));
+  }
+  REQUIRE(candidates().empty());
+  session.push(' ');
+  REQUIRE(candidates().empty());
+  session.pop();
+  session.pop();
+  session.push(' ');
+  REQUIRE(candidates() == std::vector<std::string>{"?s"});
+}
+
+TEST_CASE("optional and rest tokens", "[cli]") {
+  std::optional<int> level;
+  std::string message;
+  std::vector<bool> given;
+  std::optional<std::string> note;
+  const auto cli =
+      cli::CLI()
+          .withDefaultSchemas()
+          .withCommand("log [?i] ?s...",
+                       [&](std::optional<int> l, cli::Token m) {
+                         level = l;
+                         message = std::string(m.str(), m.len());
+                       })
+          .withCommand("blink ?i [?i] [fast]",
+                       [&](cli::Arguments args) {
+                         given.clear();
+                         for (cli::SizeT i = 0; i < args.size(); i++) {
+                           given.push_back(args[i].isValid());
+                         }
+                       })
+          .withCommand("note [?s...]", [&](std::optional<cli::Token> text) {
+            note.reset();
+            if (text) {
+              note = std::string(text->str(), text->len());
+            }
+          });
+
+  REQUIRE(cli.run("log hello"));
+  REQUIRE(!level);
+  REQUIRE(message == "hello");
+  REQUIRE(cli.run("log 3 disk  is full "));
+  REQUIRE(level == 3);
+  REQUIRE(message == "disk  is full");
+  // the rest token needs a token before optional tokens get one
+  REQUIRE(cli.run("log 3"));
+  REQUIRE(!level);
+  REQUIRE(message == "3");
+  REQUIRE(!cli.run("log"));
+
+  // one token is passed unquoted, several as typed
+  REQUIRE(cli.run(R"(log "a b")"));
+  REQUIRE(message == "a b");
+  REQUIRE(cli.run(R"(log 2 'a b' "c")"));
+  REQUIRE(message == R"('a b' "c")");
+
+  // lines over the token limit still reach a rest token
+  std::string words;
+  for (int i = 0; i < 2 * CLI_CMD_TOKENS_MAX; i++) {
+    words += " w" + std::to_string(i);
+  }
+  REQUIRE(cli.run(("log 1" + words + "  ").c_str()));
+  REQUIRE(level == 1);
+  REQUIRE(" " + message == words);
+  REQUIRE(!cli.run(("blink 1" + words).c_str()));
+
+  REQUIRE(cli.run("blink 1"));
+  REQUIRE(given == std::vector<bool>{true, true, false, false});
+  REQUIRE(cli.run("blink 1 2 fast"));
+  REQUIRE(given == std::vector<bool>{true, true, true, true});
+  REQUIRE(!cli.run("blink 1 slow"));
+  REQUIRE(!cli.run("blink 1 2 3"));
+  REQUIRE(!cli.run("blink 1 2 fast 4"));
+
+  // optional tokens which don't match the input are skipped
+  REQUIRE(cli.run("log hello world"));
+  REQUIRE(!level);
+  REQUIRE(message == "hello world");
+  REQUIRE(cli.run("blink 1 fast"));
+  REQUIRE(given == std::vector<bool>{true, true, false, true});
+
+  std::optional<int> second;
+  std::optional<float> ratio;
+  const auto set = cli::CLI().withDefaultSchemas().withCommand(
+      "set ?i [?i] [?f]",
+      [&](int, std::optional<int> i, std::optional<float> f) {
+        second = i;
+        ratio = f;
+      });
+  REQUIRE(set.run("set 1 2.5"));
+  REQUIRE(!second);
+  REQUIRE(ratio == 2.5f);
+  REQUIRE(set.run("set 1 2 0.5"));
+  REQUIRE(second == 2);
+  REQUIRE(ratio == 0.5f);
+  REQUIRE(set.run("set 1 2"));
+  REQUIRE(second == 2);
+  REQUIRE(!ratio);
+  REQUIRE(!set.run("set 1 2.5 3"));
+
+  REQUIRE(cli.run("note"));
+  REQUIRE(!note);
+  REQUIRE(cli.run("note call  home"));
+  REQUIRE(note == "call  home");
+
+  std::string help;
+  cli.getHelp([&](const char *text, int len) {
+    help.append(text, static_cast<std::size_t>(len));
+  });
+  REQUIRE(help == "log [?i] ?s... \nblink ?i [?i] [fast] \nnote [?s...] \n");
+
+  std::vector<std::string> out;
+  const auto complete = [&](const char *partial) {
+    out.clear();
+    cli.complete(partial, [&](const cli::Token &candidate) {
+      out.emplace_back(candidate.str(), candidate.len());
+    });
+    return out;
+  };
+  REQUIRE(complete("blink 1 2 f") == std::vector<std::string>{"fast"});
+  REQUIRE(complete("note a b c ") == std::vector<std::string>{"?s"});
+
+  // the rest of the line is a view into the input, it can't be deferred
+  cli::DeferredQueue<2> queue(cli);
+  REQUIRE(!queue.post("log x"));
+  REQUIRE(queue.post("blink 1"));
+
+  auto broken = cli::CLI().withDefaultSchemas();
+  REQUIRE_THROWS(broken.withCommand("a [?i] ?i", [](cli::Arguments) {}));
+  REQUIRE_THROWS(broken.withCommand("a ?s... b", [](cli::Arguments) {}));
+  REQUIRE_THROWS(broken.withCommand("a [?i]", [](int) {}));
+  REQUIRE_THROWS(broken.withCommand("a ?s...", [](const char *) {}));
+}
+
+TEST_CASE("buffered output", "[cli]") {
+  std::vector<std::string> writes;
+  const auto writer = [&writes](const char *text, int len) {
+    writes.emplace_back(text, static_cast<std::size_t>(len));
+  };
+
+  SECTION("writes are collected until the buffer is full") {
+    {
+      cli::BufferedOutput<8> out(writer);
+      out.write("abc");
+      out.write(cli::Token("defgh", 5));
+      REQUIRE(writes.empty());
+      REQUIRE(out.pending() == 8);
+      out.put('i');
+      REQUIRE(writes == std::vector<std::string>{"abcdefgh"});
+      out.write("longer than the buffer");
+      REQUIRE(writes == std::vector<std::string>{"abcdefgh", "i",
+                                                 "longer than the buffer"});
+      out.write("j");
+      out.flush();
+      out.flush();
+      out.write("k");
+    }
+    REQUIRE(writes == std::vector<std::string>{"abcdefgh", "i",
+                                               "longer than the buffer", "j",
+                                               "k"});
+  }
+
+  SECTION("callbacks write to the sink of the run") {
+    const auto cli =
+        cli::CLI()
+            .withDefaultSchemas()
+            .withCommand("hello",
+                         [](const cli::Arguments &, cli::OutputSink &out) {
+                           out.write("hello\n");
+                         })
+            .withCommand("echo ?s ?i",
+                         [](cli::Token text, int times, cli::OutputSink &out) {
+                           for (int i = 0; i < times; i++) {
+                             out.write(text);
+                           }
+                           out.put('\n');
+                         })
+            .withHelpCommand("help");
+
+    cli::BufferedOutput<64> out(writer);
+    REQUIRE(cli.run("hello", out));
+    REQUIRE(cli.run("echo ab 3", out));
+    // nothing is written without a sink
+    REQUIRE(cli.run("hello"));
+    REQUIRE(writes.empty());
+    out.flush();
+    REQUIRE(writes == std::vector<std::string>{"hello\nababab\n"});
+
+    writes.clear();
+    REQUIRE(cli.run("help", out));
+    out.flush();
+    REQUIRE(writes ==
+            std::vector<std::string>{"hello \necho ?s ?i \nhelp \n"});
+  }
+
+  SECTION("help is a single write") {
+    const auto cli = cli::CLI()
+                         .withDefaultSchemas()
+                         .withCommand("pm lim vin ?i ?i", [](int, int) {})
+                         .withCommand("ratio set ?f", [](float) {});
+    cli.getHelp(writer);
+    REQUIRE(writes ==
+            std::vector<std::string>{"pm lim vin ?i ?i \nratio set ?f \n"});
+  }
+
+  SECTION("help larger than helpTextMax is written per token") {
+    const auto tiny = cli::BasicCLI<TinyConfig>()
+                          .withDefaultSchemas()
+                          .withCommand("first ?i", [](int) {})
+                          .withCommand("second ?i", [](int) {});
+    std::string help;
+    tiny.getHelp([&](const char *text, int len) {
+      writes.emplace_back(text, static_cast<std::size_t>(len));
+      help.append(text, static_cast<std::size_t>(len));
+    });
+    REQUIRE(writes.size() > 1);
+    REQUIRE(help == "first ?i \nsecond ?i \n");
+  }
+}
+
+TEST_CASE("command cache", "[cli]") {
+  int called = -1;
+  const auto add = [&called](auto &cli, int id, const char *pattern) {
+    cli.withCommand(pattern, [&called, id](const auto &) { called = id; });
+  };
+  const char *const patterns[] = {
+      "get voltage", "get temp ?i", "set ?i",      "set ?s",      "log",
+      "log ?s...",   "pm lim ?i",   "pm lim vin", "pm [?s]",     "?s x",
+      "led ?i on",   "led 1 off",   "led ?i off", "get temp 3 now"};
+  cli::CLI plain;
+  cli::BasicCLI<CacheConfig> cached;
+  plain.withDefaultSchemas();
+  cached.withDefaultSchemas();
+  for (int i = 0; i < static_cast<int>(sizeof(patterns) / sizeof(*patterns));
+       i++) {
+    add(plain, i, patterns[i]);
+    add(cached, i, patterns[i]);
+  }
+
+  SECTION("repeated lines hit") {
+    for (int i = 0; i < 10; i++) {
+      REQUIRE(cached.run("get voltage"));
+      REQUIRE(called == 0);
+      REQUIRE(cached.run("get temp 2"));
+      REQUIRE(called == 1);
+    }
+    REQUIRE(cached.cache().hits() == 18);
+    REQUIRE(cached.cache().misses() == 2);
+  }
+
+  SECTION("same command as without the cache") {
+    const char *const words[] = {"get", "voltage", "temp", "set", "3",
+                                 "x",   "log",     "pm",   "lim", "vin",
+                                 "led", "1",       "on",   "off", "now"};
+    std::mt19937 random(7);
+    for (int i = 0; i < 20000; i++) {
+      std::string line;
+      const int count = 1 + static_cast<int>(random() % 4);
+      for (int w = 0; w < count; w++) {
+        line += words[random() % (sizeof(words) / sizeof(words[0]))];
+        line += ' ';
+      }
+      called = -1;
+      const bool expected = plain.run(line.c_str());
+      const int expectedCommand = called;
+      called = -1;
+      REQUIRE(cached.run(line.c_str()) == expected);
+      INFO(line);
+      REQUIRE(called == expectedCommand);
+    }
+    REQUIRE(cached.cache().hits() > 0);
+  }
+}
+
+namespace {
+template <typename Group>
+using Mounted = decltype(std::declval<cli::CLI &>().withGroup(
+    "pm", std::declval<Group>()));
+template <typename Group, typename = void>
+struct CanMount : std::false_type {};
+template <typename Group>
+struct CanMount<Group, std::void_t<Mounted<Group>>> : std::true_type {};
+} // namespace
+
+TEST_CASE("command groups", "[cli]") {
+  static_assert(CanMount<const cli::CLI &>::value);
+  static_assert(!CanMount<cli::CLI>::value, "temporaries can't be groups");
+
+  std::string called;
+  const auto call = [&called](const char *name) {
+    return [&called, name](const cli::Arguments &) { called = name; };
+  };
+  auto lim = cli::CLI().withDefaultSchemas();
+  lim.withCommand("vin ?i ?i", [&](int min, int max) {
+       called = "vin " + std::to_string(max - min);
+     })
+      .withCommand("vout ?i ?i", call("vout"));
+  auto pm = cli::CLI().withDefaultSchemas();
+  pm.withCommand("reset", call("reset"))
+      .withGroup("lim", lim)
+      .withHelpCommand("help");
+  auto cli = cli::CLI().withDefaultSchemas();
+  cli.withCommand("version", call("version"))
+      .withGroup("pm", pm)
+      .withHelpCommand("help");
+
+  SECTION("lines are dispatched to the group of their prefix") {
+    REQUIRE(cli.run("pm lim vin 3 5"));
+    REQUIRE(called == "vin 2");
+    REQUIRE(cli.run("pm reset"));
+    REQUIRE(called == "reset");
+    REQUIRE(cli.run("version"));
+    REQUIRE(called == "version");
+    REQUIRE(cli.run("\"pm\" lim vout 1 2"));
+    REQUIRE(called == "vout");
+
+    called.clear();
+    REQUIRE(!cli.run("pm"));
+    REQUIRE(!cli.run("pm lim"));
+    REQUIRE(!cli.run("lim vin 3 5"));
+    REQUIRE(!cli.run("pm version"));
+    REQUIRE(called.empty());
+  }
+
+  SECTION("commands can't start with the prefix of a group") {
+    REQUIRE_THROWS(cli.withCommand("pm status", call("status")));
+    REQUIRE_THROWS(cli.withGroup("pm", lim));
+    REQUIRE_THROWS(
+        cli::CLI().withCommand("lim", call("lim")).withGroup("lim", lim));
+    REQUIRE(!cli.run("pm status"));
+    REQUIRE(called.empty());
+  }
+
+  SECTION("match finds the command in the group") {
+    cli::Arguments arguments;
+    const char *const line = "pm lim vin 1 4";
+    const auto *command = cli.match(
+        cli::parsers::tokenize<cli::CLI::Tokens>(line, std::strlen(line)),
+        arguments);
+    REQUIRE(command != nullptr);
+    command->run(arguments);
+    REQUIRE(called == "vin 3");
+  }
+
+  SECTION("every level has its own help") {
+    std::string written;
+    cli::BufferedOutput<64> out([&written](const char *text, int len) {
+      written.append(text, static_cast<std::size_t>(len));
+    });
+    REQUIRE(cli.run("help", out));
+    out.flush();
+    REQUIRE(written == "version \npm ... \nhelp \n");
+
+    written.clear();
+    REQUIRE(cli.run("pm help", out));
+    out.flush();
+    REQUIRE(written == "reset \nlim ... \nhelp \n");
+  }
+
+  SECTION("completion enters groups") {
+    std::vector<std::string> out;
+    const auto complete = [&](const char *partial) {
+      out.clear();
+      cli.complete(partial, [&out](const cli::Token &candidate) {
+        out.emplace_back(candidate.str(), candidate.len());
+      });
+      std::sort(out.begin(), out.end());
+      return out;
+    };
+    using Strings = std::vector<std::string>;
+    REQUIRE(complete("") == Strings{"help", "pm", "version"});
+    REQUIRE(complete("pm ") == Strings{"help", "lim", "reset"});
+    REQUIRE(complete("pm l") == Strings{"lim"});
+    REQUIRE(complete("pm lim v") == Strings{"vin", "vout"});
+    REQUIRE(complete("pm lim vin ") == Strings{"?i"});
+    REQUIRE(complete("pm reset ").empty());
+  }
+}
+
+TEST_CASE("choice placeholders", "[cli]") {
+  enum class Mode { on, off, blink };
+  int led = -1;
+  Mode mode = Mode::off;
+  int level = -1;
+  auto cli = cli::CLI().withDefaultSchemas();
+  cli.withCommand("led ?i ?{on|off|blink}",
+                  [&](int index, Mode value) {
+                    led = index;
+                    mode = value;
+                  })
+      .withCommand("fan ?{on|off|blink}",
+                   [&](const auto &args) {
+                     level = args[1].template get<int>();
+                   })
+      .withCommand("log ?{error|warn|info|debug|trace} [?s]",
+                   [&](int value, std::optional<cli::Token>) {
+                     level = value;
+                   });
+
+  SECTION("words parse to their index") {
+    REQUIRE(cli.run("led 2 blink"));
+    REQUIRE(led == 2);
+    REQUIRE(mode == Mode::blink);
+    REQUIRE(cli.run("led 3 on"));
+    REQUIRE(mode == Mode::on);
+    REQUIRE(cli.run("fan off"));
+    REQUIRE(level == 1);
+    REQUIRE(cli.run("log trace"));
+    REQUIRE(level == 4);
+    REQUIRE(cli.run("log warn now"));
+    REQUIRE(level == 1);
+    REQUIRE(cli.run("led 1 \"off\""));
+    REQUIRE(mode == Mode::off);
+  }
+
+  SECTION("other tokens are rejected") {
+    for (const char *line : {"led 1 o", "led 1 of", "led 1 offf", "led 1 ON",
+                             "led 1 on|off", "led 1 blink}", "fan", "fan 1",
+                             "log err", "log {error", "fan \"\""}) {
+      INFO(line);
+      REQUIRE(!cli.run(line));
+    }
+  }
+
+  SECTION("every word of larger sets") {
+    const char *const words[] = {"a",  "b",  "ab", "ba",
+                                 "aa", "bb", "abc", "cba"};
+    std::string pattern = "?{";
+    for (const char *word : words) {
+      pattern += word;
+      pattern += '|';
+    }
+    pattern.back() = '}';
+    const cli::Token token(pattern.c_str(), pattern.size());
+    const cli::Choices choices(token);
+    for (int i = 0; i < 8; i++) {
+      const cli::Token word(words[i], std::strlen(words[i]));
+      REQUIRE(choices.find(token, word) == i);
+    }
+    REQUIRE(choices.find(token, cli::Token("c", 1)) == -1);
+    REQUIRE(choices.find(token, cli::Token("abcd", 4)) == -1);
+    REQUIRE(choices.find(token, cli::Token("?{a", 3)) == -1);
+  }
+
+  SECTION("invalid placeholders") {
+    const auto choices = [](const char *pattern) {
+      return cli::Choices(cli::Token(pattern, std::strlen(pattern)));
+    };
+    REQUIRE_THROWS(choices("?{on|on}"));
+    REQUIRE_THROWS(choices("?{on||off}"));
+    REQUIRE_THROWS(choices("?{a|b|c|d|e|f|g|h|i}"));
+  }
+
+  SECTION("choices take no schemas") {
+    // every command keeps its tables, up to cmdFormatsMax distinct ones
+    for (const char *pattern :
+         {"a ?{on|off}", "b ?{up|down}", "c ?{x|y|z}", "d ?{1|2}"}) {
+      cli.withCommand(pattern, [&](int value) { level = value; });
+    }
+    REQUIRE(cli.run("c z"));
+    REQUIRE(level == 2);
+    cli.withCommand("e ?{up|down} ?{up|down} ?{in|out}",
+                    [&](int, int, int value) { level = value; });
+    REQUIRE(cli.run("e up down out"));
+    REQUIRE(level == 1);
+    REQUIRE_THROWS(
+        cli.withCommand("f ?{a|b} ?{c|d} ?{e|f}", [](int, int, int) {}));
+  }
+
+  SECTION("completion lists the words") {
+    std::vector<std::string> out;
+    const auto complete = [&](const char *partial) {
+      out.clear();
+      cli.complete(partial, [&out](const cli::Token &candidate) {
+        out.emplace_back(candidate.str(), candidate.len());
+      });
+      std::sort(out.begin(), out.end());
+      return out;
+    };
+    using Strings = std::vector<std::string>;
+    REQUIRE(complete("led 1 ") == Strings{"blink", "off", "on"});
+    REQUIRE(complete("led 1 o") == Strings{"off", "on"});
+    REQUIRE(complete("log e") == Strings{"error"});
+    REQUIRE(complete("log x").empty());
+  }
+
+  SECTION("help shows the placeholder") {
+    std::string help;
+    cli.getHelp([&help](const char *text, int len) {
+      help.append(text, static_cast<std::size_t>(len));
+    });
+    REQUIRE(help == "led ?i ?{on|off|blink} \nfan ?{on|off|blink} \n"
+                    "log ?{error|warn|info|debug|trace} [?s] \n");
+  }
+
+#ifdef CLI_HAS_STATIC_PATTERNS
+  SECTION("compile-time patterns") {
+    static constexpr cli::Token onOff("?{on|off}", 9);
+    static_assert(cli::Choices(onOff).find(onOff, cli::Token("off", 3)) == 1);
+
+    auto fixed = cli::CLI().withCommand<"led ?i ?{on|off|blink}">(
+        [&](int index, Mode value) {
+          led = index;
+          mode = value;
+        });
+    REQUIRE(fixed.run("led 4 blink"));
+    REQUIRE(led == 4);
+    REQUIRE(mode == Mode::blink);
+    REQUIRE(!fixed.run("led 4 blank"));
+  }
+#endif
+}
+
+TEST_CASE("integer placeholders", "[cli]") {
+  uint64_t value = 0;
+  int width = 0;
+  const auto store = [&](auto v) {
+    value = static_cast<uint64_t>(v);
+    width = static_cast<int>(sizeof(v));
+  };
+  auto cli = cli::CLI().withDefaultSchemas();
+  cli.withCommand("u8 ?u8", [&](uint8_t v) { store(v); })
+      .withCommand("i16 ?i16[-100..100]", [&](int16_t v) { store(v); })
+      .withCommand("u32 ?u32", [&](uint32_t v) { store(v); })
+      .withCommand("i64 ?i64", [&](int64_t v) { store(v); })
+      .withCommand("u64 ?u64", [&](uint64_t v) { store(v); })
+      .withCommand("port ?u16[1024..65535] [?i8[-3..-1]]",
+                   [&](uint16_t v, std::optional<int8_t> offset) {
+                     store(v);
+                     value += static_cast<uint64_t>(offset.value_or(0));
+                   })
+      .withCommand("i32 ?i32", [&](int v) { store(v); });
+
+  const auto parses = [&](const char *line, uint64_t expected, int bytes) {
+    value = 0;
+    width = 0;
+    INFO(line);
+    REQUIRE(cli.run(line));
+    REQUIRE(value == expected);
+    REQUIRE(width == bytes);
+  };
+
+  SECTION("values within the range keep their width") {
+    parses("u8 0", 0, 1);
+    parses("u8 255", 255, 1);
+    parses("u8 +7", 7, 1);
+    parses("u8 0xfF", 255, 1);
+    parses("u8 0b1010", 10, 1);
+    parses("i16 -100", static_cast<uint64_t>(-100), 2);
+    parses("i16 0x64", 100, 2);
+    parses("i16 -0b11", static_cast<uint64_t>(-3), 2);
+    parses("u32 4294967295", 4294967295u, 4);
+    parses("i64 -9223372036854775808",
+           static_cast<uint64_t>(std::numeric_limits<int64_t>::min()), 8);
+    parses("u64 0xffffffffffffffff", ~uint64_t(0), 8);
+    parses("port 65535", 65535, 2);
+    parses("port 2000 -1", 1999, 2);
+    parses("i32 -2147483648", static_cast<uint64_t>(-2147483648ll), 4);
+    parses("u8 \"12\"", 12, 1);
+  }
+
+  SECTION("values out of range or malformed are rejected") {
+    for (const char *line :
+         {"u8 256", "u8 -1", "u8 -0", "u8 0x100", "u8 0x", "u8 0b2", "u8 1a",
+          "u8 ", "u8 +", "u8 99999999999999999999999", "i16 101", "i16 -101",
+          "i16 0x65", "u32 4294967296", "i64 9223372036854775808",
+          "u64 18446744073709551616", "port 1023", "port 2000 0",
+          "port 2000 -4", "i32 2147483648", "u8 1.0", "u8 0x-1"}) {
+      INFO(line);
+      REQUIRE(!cli.run(line));
+    }
+  }
+
+  SECTION("formats") {
+    const auto format = [](const char *pattern) {
+      return cli::IntegerFormat(cli::Token(pattern, std::strlen(pattern)));
+    };
+    REQUIRE(format("?u8").tag() == cli::constants::tagUInt8);
+    REQUIRE(format("?i32[0..9]").tag() == cli::constants::tagInt);
+    REQUIRE(format("?u64").tag() == cli::constants::tagUInt64);
+    REQUIRE(!cli::IntegerFormat::isInteger(cli::Token("?i", 2)));
+    REQUIRE(!cli::IntegerFormat::isInteger(cli::Token("?u7", 3)));
+    REQUIRE(!cli::IntegerFormat::isInteger(cli::Token("?u8[", 4)));
+    REQUIRE_THROWS(format("?u8[0..256]"));
+    REQUIRE_THROWS(format("?u8[-1..5]"));
+    REQUIRE_THROWS(format("?i8[5..1]"));
+    REQUIRE_THROWS(format("?i8[1.5]"));
+    REQUIRE_THROWS(format("?i8[..]"));
+  }
+
+  SECTION("typed callbacks must take the width") {
+    REQUIRE_THROWS(cli.withCommand("bad ?u8", [](int) {}));
+  }
+
+  SECTION("integers take no schemas") {
+    // as in the README, on the default config
+    const auto reg = cli::CLI().withCommand(
+        "reg ?u16 ?u8[0..7]",
+        [&](uint16_t address, uint8_t bit) { store(address * 8 + bit); });
+    REQUIRE(reg.run("reg 0x10 7"));
+    REQUIRE(value == 0x87);
+    REQUIRE(!reg.run("reg 0x10 8"));
+    // equal placeholders share their format
+    cli.withCommand("rgb ?u8 ?u8 ?u8", [&](uint8_t r, uint8_t g, uint8_t b) {
+      store(r + g + b);
+    });
+    parses("rgb 1 2 3", 6, 4);
+    REQUIRE_THROWS(cli.withCommand("bad ?u8 ?u16 ?u32", [](cli::Arguments) {}));
+  }
+
+#ifdef CLI_HAS_STATIC_PATTERNS
+  SECTION("compile-time patterns") {
+    auto fixed = cli::CLI().withCommand<"reg ?u16 ?u8[0..7]">(
+        [&](uint16_t address, uint8_t bit) { store(address * 8 + bit); });
+    REQUIRE(fixed.run("reg 0x10 7"));
+    REQUIRE(value == 0x87);
+    REQUIRE(!fixed.run("reg 0x10 8"));
+    REQUIRE(!fixed.run("reg 0x10000 0"));
+  }
+#endif
+}
+
+#ifdef CLI_HAS_CONSTEXPR_TABLES
+namespace {
+int ledState = -1;
+void setLed(const cli::Arguments &args, cli::OutputSink &out) {
+  ledState = args[1].get<int>();
+  out.write("ok\n");
+}
+void setLimits(const cli::Arguments &args, cli::OutputSink &) {
+  ledState = args[2].get<int>() + args[3].get<int>();
+}
+bool parseOnOff(const cli::Token &token, cli::Argument &arg) {
+  const bool on = token == cli::Token("on", 2);
+  if (!on && !(token == cli::Token("off", 3))) {
+    return false;
+  }
+  arg = cli::Argument::create(cli::constants::tagInt, on ? 1 : 0);
+  return true;
+}
+
+constexpr auto constantTable = [] {
+  cli::CLI cli;
+  cli.withDefaultSchemas()
+      .withSchema("?b", parseOnOff)
+      .withCommand("led ?i", setLed)
+      .withCommand("led ?b", setLed)
+      .withCommand<"pm lim ?i ?i">(setLimits)
+      .withCommand("note ?s...", setLed)
+      .withHelpCommand("help");
+  return cli;
+}();
+} // namespace
+
+TEST_CASE("constexpr tables", "[cli]") {
+  static_assert(cli::schemaInteger.getTag() == cli::constants::tagInt);
+  static_assert(cli::schemaText.isSchema(cli::Token("?s", 2)));
+
+  std::string written;
+  cli::BufferedOutput<16> out([&written](const char *text, int len) {
+    written.append(text, static_cast<std::size_t>(len));
+  });
+  REQUIRE(constantTable.run("led 3", out));
+  REQUIRE(ledState == 3);
+  REQUIRE(constantTable.run("led on", out));
+  REQUIRE(ledState == 1);
+  REQUIRE(constantTable.run("pm lim 2 5"));
+  REQUIRE(ledState == 7);
+  REQUIRE(!constantTable.run("led x"));
+  REQUIRE(!constantTable.run("pm lim 2"));
+
+  REQUIRE(constantTable.run("help", out));
+  out.flush();
+  REQUIRE(written == "ok\nok\nled ?i \nled ?b \npm lim ?i ?i \n"
+                     "note ?s... \nhelp \n");
+}
+#endif
@@ -0,0 +1,51 @@
+#include <catch2/catch_test_macros.hpp>
+
+#define CLI_ARG_TEXT_VIEW
+#include <cli/cli.hpp>
+#include <string>
+
+TEST_CASE("string arguments point into the input", "[view]") {
+  const char *input = "echo a_token_longer_than_sixteen_characters";
+  cli::Token token;
+  const auto cli = cli::CLI().withDefaultSchemas().withCommand(
+      "echo ?s", [&](cli::Arguments args) { token = args[1].getToken(); });
+
+  REQUIRE(cli.run(input));
+  REQUIRE(token.str() == input + 5);
+  REQUIRE(std::string(token.str(), token.len()) ==
+          "a_token_longer_than_sixteen_characters");
+}
+
+TEST_CASE("typed callbacks receive views", "[view]") {
+  std::string name;
+  int value = 0;
+  const auto cli = cli::CLI().withDefaultSchemas().withCommand(
+      "set ?s ?i", [&](cli::Token n, int v) {
+        name = std::string(n.str(), n.len());
+        value = v;
+      });
+
+  REQUIRE(cli.run("set voltage 42"));
+  REQUIRE(name == "voltage");
+  REQUIRE(value == 42);
+}
+
+TEST_CASE("quoted views are unescaped by the callback", "[view]") {
+  const char *input = R"(echo "plain text" "say \"hi\"")";
+  std::string plain, escaped;
+  const char *plainStr = nullptr;
+  const auto cli = cli::CLI().withDefaultSchemas().withCommand(
+      "echo ?s ?s", [&](cli::Token a, cli::Token b) {
+        plainStr = a.str();
+        plain = std::string(a.str(), a.len());
+        REQUIRE(!a.escaped());
+        REQUIRE(b.escaped());
+        char scratch[16];
+        escaped = std::string(scratch, b.unescape(scratch, sizeof(scratch)));
+      });
+
+  REQUIRE(cli.run(input));
+  REQUIRE(plainStr == input + 6);
+  REQUIRE(plain == "plain text");
+  REQUIRE(escaped == "say \"hi\"");
+}
@@ -0,0 +1,265 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <cli/executor.hpp>
+
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+struct ViewConfig : cli::DefaultConfig {
+  static constexpr bool argTextView = true;
+};
+
+struct CacheConfig : cli::DefaultConfig {
+  static constexpr std::size_t commandCacheSize = 4;
+};
+
+struct TinyConfig : cli::DefaultConfig {
+  static constexpr std::size_t cmdTokensMax = 3;
+};
+
+struct StatsConfig : cli::DefaultConfig {
+  static constexpr bool stats = true;
+};
+
+template <typename F> void onThreads(int count, F f) {
+  std::vector<std::thread> threads;
+  for (int t = 0; t < count; t++) {
+    threads.emplace_back(f, t);
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+}
+} // namespace
+
+TEST_CASE("concurrent run", "[concurrency]") {
+  std::atomic<long> sum{0};
+  std::atomic<int> hellos{0};
+  const auto cli =
+      cli::CLI()
+          .withDefaultSchemas()
+          .withCommand("hello", [&](cli::Arguments) { hellos++; })
+          .withCommand("add ?i", [&](int value) { sum += value; })
+          .withCommand("pm lim vin ?i ?i",
+                       [&](int min, int max) { sum += max - min; });
+
+  constexpr int threads = 8;
+  constexpr int lines = 2000;
+  std::atomic<int> misses{0};
+  onThreads(threads, [&](int t) {
+    std::string add = "add " + std::to_string(t);
+    for (int i = 0; i < lines; i++) {
+      bool ok = cli.run("hello");
+      ok &= cli.run(add.c_str());
+      ok &= cli.run("pm lim vin 3 5");
+      ok &= !cli.run("no such command");
+      misses += ok ? 0 : 1;
+    }
+  });
+
+  REQUIRE(misses == 0);
+  REQUIRE(hellos == threads * lines);
+  // each thread adds its index and 2 per line
+  REQUIRE(sum == lines * (threads * (threads - 1) / 2 + 2 * threads));
+}
+
+TEST_CASE("concurrent runs share the command cache", "[concurrency]") {
+  std::atomic<long> sum{0};
+  const auto cli =
+      cli::BasicCLI<CacheConfig>()
+          .withDefaultSchemas()
+          .withCommand("get voltage", [&] { sum += 1; })
+          .withCommand("get temp ?i", [&](int value) { sum += value; })
+          .withCommand("set ?i", [&](int value) { sum -= value; });
+
+  constexpr int threads = 8;
+  constexpr int lines = 2000;
+  std::atomic<int> misses{0};
+  onThreads(threads, [&](int t) {
+    const std::string temp = "get temp " + std::to_string(t);
+    for (int i = 0; i < lines; i++) {
+      bool ok = cli.run("get voltage");
+      ok &= cli.run(temp.c_str());
+      ok &= cli.run("set 1");
+      misses += ok ? 0 : 1;
+    }
+  });
+
+  REQUIRE(misses == 0);
+  REQUIRE(sum == lines * (threads * (threads - 1) / 2));
+  const auto &cache = cli.cache();
+  REQUIRE(cache.hits() + cache.misses() == 3u * threads * lines);
+  REQUIRE(cache.hits() > cache.misses());
+}
+
+TEST_CASE("executor workers share the command cache", "[concurrency]") {
+  // more commands than entries, so workers insert and reorder at once
+  std::atomic<long> sum{0};
+  cli::BasicCLI<CacheConfig> cli;
+  cli.withDefaultSchemas();
+  const char *const patterns[] = {"a ?i", "b ?i", "c ?i", "d ?i",
+                                  "e ?i", "f ?i", "g ?i", "h ?i"};
+  for (const char *pattern : patterns) {
+    cli.withCommand(pattern, [&](int value) { sum += value; });
+  }
+
+  constexpr int threads = 4;
+  constexpr int lines = 2000;
+  std::atomic<int> rejected{0};
+  {
+    cli::BasicExecutor<CacheConfig> executor(cli, 4);
+    onThreads(threads, [&](int t) {
+      for (int i = 0; i < lines; i++) {
+        // mostly the first commands, so hits move them ahead
+        const int command = (i + t) % 3 == 0 ? (i + t) % 8 : (i + t) % 2;
+        const std::string line =
+            std::string(1, static_cast<char>('a' + command)) + " 1";
+        rejected += executor.submit(line.c_str()) ? 0 : 1;
+      }
+    });
+  }
+
+  REQUIRE(rejected == 0);
+  REQUIRE(sum == threads * lines);
+  const auto &cache = cli.cache();
+  REQUIRE(cache.hits() + cache.misses() == 1u * threads * lines);
+  std::vector<cli::SizeT> cached;
+  for (std::size_t slot = 0; slot < CacheConfig::commandCacheSize; slot++) {
+    const cli::SizeT command = cache.command(slot);
+    REQUIRE(command != cache.none);
+    for (const cli::SizeT other : cached) {
+      REQUIRE(command != other);
+    }
+    cached.push_back(command);
+  }
+}
+
+TEST_CASE("executor runs submitted commands on workers", "[concurrency]") {
+  std::atomic<long> sum{0};
+  std::atomic<long> length{0};
+  const auto cli =
+      cli::BasicCLI<ViewConfig>()
+          .withDefaultSchemas()
+          .withCommand("add ?i", [&](int value) { sum += value; })
+          .withCommand("echo ?s",
+                       [&](cli::Token text) { length += text.len(); });
+
+  constexpr int threads = 8;
+  constexpr int lines = 1000;
+  std::atomic<int> rejected{0};
+  {
+    cli::BasicExecutor<ViewConfig> executor(cli, 4);
+    onThreads(threads, [&](int t) {
+      for (int i = 0; i < lines; i++) {
+        // the line is gone before the job runs
+        std::string line = "add " + std::to_string(i);
+        executor.submit(line.c_str());
+        line = "echo " + std::string(static_cast<std::size_t>(t + 1), 'x');
+        executor.submit(line.c_str());
+        rejected += executor.submit("unknown") ? 0 : 1;
+      }
+    });
+    executor.wait();
+
+    REQUIRE(rejected == threads * lines);
+    REQUIRE(sum == threads * (lines * (lines - 1) / 2));
+    REQUIRE(length == lines * (threads * (threads + 1) / 2));
+
+    // jobs still queued when the executor is destroyed are run
+    for (int i = 0; i < 100; i++) {
+      executor.submit("add 1");
+    }
+  }
+  REQUIRE(sum == threads * (lines * (lines - 1) / 2) + 100);
+}
+
+TEST_CASE("executor keeps the rest of a line alive", "[concurrency]") {
+  std::atomic<long> length{0};
+  const auto cli = cli::CLI().withDefaultSchemas().withCommand(
+      "say ?s...", [&](cli::Token text) { length += text.len(); });
+  {
+    cli::Executor executor(cli, 2);
+    for (int i = 1; i <= 100; i++) {
+      std::string line = "say " + std::string(static_cast<std::size_t>(i), 'x');
+      line += " and more";
+      executor.submit(line.c_str());
+    }
+  }
+  REQUIRE(length == 100 * 101 / 2 + 100 * 9);
+}
+
+TEST_CASE("executor rejects lines over the token limit", "[concurrency]") {
+  std::atomic<int> calls{0};
+  const auto cli = cli::BasicCLI<TinyConfig>().withDefaultSchemas().withCommand(
+      "set ?i ?i", [&](int, int) { calls++; });
+  {
+    cli::BasicExecutor<TinyConfig> executor(cli, 2);
+    REQUIRE(executor.submit("set 1 2"));
+    // the fourth token can't be dropped to match "set ?i ?i"
+    REQUIRE(!executor.submit("set 1 2 3"));
+  }
+  REQUIRE(calls == 1);
+}
+
+TEST_CASE("executor runs the help and stats commands", "[concurrency]") {
+  std::string written;
+  cli::BufferedOutput<64> out([&written](const char *text, int len) {
+    written.append(text, static_cast<std::size_t>(len));
+  });
+  const auto cli = cli::BasicCLI<StatsConfig>()
+                       .withHelpCommand("help")
+                       .withStatsCommand("stats");
+  {
+    // a single worker, so the sink is written by one thread
+    cli::BasicExecutor<StatsConfig> executor(cli, 1);
+    REQUIRE(executor.submit("help", 4, out));
+    executor.wait();
+    out.flush();
+    REQUIRE(written == "help \nstats \n");
+
+    written.clear();
+    REQUIRE(executor.submit("stats", 5, out));
+    REQUIRE(executor.submit("help"));
+  }
+  out.flush();
+  REQUIRE(written.rfind("help 0\nstats 0\nrejected", 0) == 0);
+}
+
+TEST_CASE("deferred queue with a producer and a consumer", "[concurrency]") {
+  constexpr int lines = 100000;
+  int next = 0;
+  int outOfOrder = 0;
+  const auto cli =
+      cli::CLI().withDefaultSchemas().withCommand("seq ?i", [&](int value) {
+        outOfOrder += value == next ? 0 : 1;
+        next = value + 1;
+      });
+  cli::DeferredQueue<16> queue(cli);
+
+  std::size_t full = 0;
+  std::thread producer([&] {
+    char line[32];
+    for (int i = 0; i < lines; i++) {
+      std::snprintf(line, sizeof(line), "seq %d", i);
+      while (!queue.post(line)) {
+        full++;
+        std::this_thread::yield();
+      }
+    }
+  });
+  std::size_t polled = 0;
+  while (polled < static_cast<std::size_t>(lines)) {
+    polled += queue.poll();
+    std::this_thread::yield();
+  }
+  producer.join();
+
+  REQUIRE(polled == static_cast<std::size_t>(lines));
+  REQUIRE(outOfOrder == 0);
+  REQUIRE(next == lines);
+  REQUIRE(queue.dropped() == full);
+}
@@ -0,0 +1,152 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <cli/cli.hpp>
+
+#include <cctype>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+using Spans = std::vector<std::pair<std::size_t, std::size_t>>;
+
+// The std::isspace based splitter the tokenizer replaced, kept as reference
+bool referenceSplitter(const char *input, std::size_t &tokenStart,
+                       std::size_t &tokenLen) {
+  while (std::isspace(static_cast<unsigned char>(*(input + tokenStart)))) {
+    tokenStart++;
+  }
+  if (*(input + tokenStart) == 0) {
+    return false;
+  }
+
+  tokenLen = 0;
+  while (!std::isspace(
+             static_cast<unsigned char>(*(input + tokenStart + tokenLen))) &&
+         *(input + tokenStart + tokenLen) != 0) {
+    tokenLen++;
+  }
+
+  return tokenLen != 0;
+}
+
+Spans referenceSpans(const std::string &input) {
+  Spans spans;
+  std::size_t start = 0, len = 0;
+  while (referenceSplitter(input.c_str(), start, len)) {
+    spans.emplace_back(start, len);
+    start += len;
+  }
+  return spans;
+}
+
+Spans spans(const std::string &input, std::size_t inputLen) {
+  Spans spans;
+  std::size_t start = 0, len = 0;
+  while (cli::parsers::tokenSplitter(input.c_str(), inputLen, start, len)) {
+    spans.emplace_back(start, len);
+    start += len;
+  }
+  return spans;
+}
+} // namespace
+
+TEST_CASE("tokenizer matches the reference splitter", "[tokenizer]") {
+  std::mt19937 rng(1234);
+  // every whitespace character, their neighbours and bytes with the high bit
+  const std::string alphabet = std::string(" \t\n\v\f\r\x08\x0e\x1f!aZ?09") +
+                               "\x80\x89\xa0\xff\x8d\x7f";
+  std::uniform_int_distribution<std::size_t> pick(0, alphabet.size() - 1);
+  std::uniform_int_distribution<std::size_t> length(0, 200);
+
+  for (int i = 0; i < 20000; i++) {
+    std::string input(length(rng), ' ');
+    for (char &c : input) {
+      c = alphabet[pick(rng)];
+    }
+    const Spans expected = referenceSpans(input);
+    REQUIRE(spans(input, input.size()) == expected);
+
+    // tokens after an embedded null are ignored like in a C string
+    std::string withNull = input + '\0' + "after";
+    REQUIRE(spans(withNull, withNull.size()) == expected);
+
+    const cli::Tokens tokens = cli::parsers::tokenParser(input.c_str());
+    REQUIRE(tokens.size() == std::min<std::size_t>(expected.size(),
+                                                   CLI_CMD_TOKENS_MAX));
+    for (cli::SizeT t = 0; t < tokens.size(); t++) {
+      REQUIRE(tokens[t].str() == input.c_str() + expected[t].first);
+      REQUIRE(tokens[t].len() == static_cast<cli::SizeT>(expected[t].second));
+    }
+  }
+}
+
+TEST_CASE("tokenizer respects the input length", "[tokenizer]") {
+  const std::string input = "hello   world_with_a_linetoken  x";
+  REQUIRE(spans(input, 5) == Spans{{0, 5}});
+  REQUIRE(spans(input, 3) == Spans{{0, 3}});
+  REQUIRE(spans(input, 20) == Spans{{0, 5}, {8, 12}});
+  REQUIRE(spans(input, 0).empty());
+}
+
+TEST_CASE("quoted tokens", "[tokenizer]") {
+  // spans include the quotes and end at the closing quote
+  const std::string input = R"(a "b c" 'd\' e' f "")";
+  REQUIRE(spans(input, input.size()) ==
+          Spans{{0, 1}, {2, 5}, {8, 7}, {16, 1}, {18, 2}});
+
+  const cli::Tokens tokens = cli::parsers::tokenParser(input.c_str());
+  REQUIRE(tokens.size() == 5);
+  REQUIRE(tokens[1].str() == input.c_str() + 3);
+  REQUIRE(tokens[1].len() == 3);
+  REQUIRE(!tokens[1].escaped());
+  REQUIRE(tokens[2].escaped());
+  REQUIRE(std::string(tokens[2].str(), tokens[2].len()) == R"(d\' e)");
+  char value[8];
+  REQUIRE(std::string(value, tokens[2].unescape(value, sizeof(value))) ==
+          "d' e");
+  REQUIRE(tokens[4].len() == 0);
+
+  REQUIRE(cli::parsers::tokenParser(R"("" '')").size() == 2);
+  REQUIRE(cli::parsers::tokenParser(R"("" '')")[0].len() == 0);
+  // quotes inside unquoted text are part of it
+  REQUIRE(cli::parsers::tokenParser(R"(a"b c)").size() == 2);
+}
+
+TEST_CASE("malformed quotes", "[tokenizer]") {
+  // quotes which aren't closed, or are followed by more than whitespace
+  for (const std::string input :
+       {R"(echo "abc)", R"(echo 'd\' e'f)", R"("ab"cd x)", R"(a "b\")",
+        R"(a ")", R"('a'")"}) {
+    REQUIRE(cli::parsers::tokenParser(input.c_str()).size() == 0);
+    bool truncated, malformed;
+    cli::parsers::tokenize<cli::Tokens>(input.c_str(), input.size(),
+                                        truncated, malformed);
+    REQUIRE(malformed);
+    // the splitter stops at the malformed token
+    REQUIRE(spans(input, input.size()).size() <= 1);
+  }
+
+  // a null character or the end of the input may follow the closing quote
+  const std::string closed = std::string(R"("ab")") + '\0' + "cd";
+  REQUIRE(spans(closed, closed.size()) == Spans{{0, 4}});
+  REQUIRE(spans(closed, 5) == Spans{{0, 4}});
+  bool truncated, malformed;
+  REQUIRE(cli::parsers::tokenize<cli::Tokens>(closed.c_str(), closed.size(),
+                                              truncated, malformed)
+              .size() == 1);
+  REQUIRE(!malformed);
+
+  // quotes past the token limit are checked too
+  std::string words;
+  for (int i = 0; i < 2 * CLI_CMD_TOKENS_MAX; i++) {
+    words += " w";
+  }
+  const std::string line = words + R"( "open)";
+  REQUIRE(cli::parsers::tokenize<cli::Tokens>(line.c_str(), line.size(),
+                                              truncated, malformed)
+              .size() == 0);
+  REQUIRE(malformed);
+  REQUIRE(!truncated);
+}